@@ -1,21 +1,101 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     /* for memfd_create() */
+#endif
+
 #include "opalloc.h"
 
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define OP_CAN_MAP 1
+#else
+#define OP_CAN_MAP 0
+#endif
+
+#if OP_CAN_MAP
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define OP_CAN_THREAD 1
+#else
+#define OP_CAN_THREAD 0
+#endif
+
+#if OP_TRACE && OP_CAN_MAP
+#define OP_CAN_TRACE 1
+#else
+#define OP_CAN_TRACE 0
+#endif
 
 /*******************************************************************************
 * Useful macros
 *******************************************************************************/
 
 #define UNUSED(X) ((void)(X))
+#define NO_SLOT   SIZE_MAX
 
-/*******************************************************************************
-* Static helper function declarations
-*******************************************************************************/
+/* objects at least this large are scrubbed with non-temporal stores so scrubbing does not evict the cache */
+#if !defined(OP_SCRUB_STREAMING_THRESHOLD)
+#define OP_SCRUB_STREAMING_THRESHOLD 4096
+#endif
 
-static bool fill_chunks(op_allocator allocator, const size_t offset, const size_t object_count);
-static bool grow_pool(op_allocator allocator);
+/* lets the kernel reclaim pages lazily where it can, else drops them at once */
+#if OP_CAN_MAP && defined(MADV_FREE)
+#define OP_MADV_RELEASE MADV_FREE
+#elif OP_CAN_MAP
+#define OP_MADV_RELEASE MADV_DONTNEED
+#endif
+
+/* smallest share of a chunk, in bytes, worth handing to a thread of its own during parallel initialization */
+#if !defined(OP_PARALLEL_INIT_SLICE)
+#define OP_PARALLEL_INIT_SLICE (4 * 1024 * 1024)
+#endif
+
+/* identifies snapshot files; the version changes whenever the layout below does */
+#define SNAPSHOT_MAGIC   "OPALLOC"
+#define SNAPSHOT_VERSION 2
+
+/* identifies persistent pool files */
+#define PERSISTENT_MAGIC   "OPAPOOL"
+#define PERSISTENT_VERSION 1
+
+/* identifies shared pool segments */
+#define SHARED_MAGIC   "OPASHRD"
+#define SHARED_VERSION 2
+
+/* identifies trace files */
+#define TRACE_MAGIC   "OPTRACE"
+#define TRACE_VERSION 1
+
+/* tracing costs nothing unless it is compiled in, and no more than a load and a branch the processor predicts while
+ * no trace runs; the call and everything behind it stay out of line */
+#if OP_CAN_TRACE
+#define TRACE(ALLOCATOR, EVENT, SLOT)                                                                       \
+    (__builtin_expect(atomic_load_explicit(&trace_state.active, memory_order_relaxed), 0)                   \
+     ? trace((ALLOCATOR), (EVENT), (SLOT)) : (void) 0)
+#else
+#define TRACE(ALLOCATOR, EVENT, SLOT) ((void) 0)
+#endif
+
+/* allocations and deallocations between opportunistic checks for decayed chunks */
+#if !defined(OP_DECAY_CHECK_INTERVAL)
+#define OP_DECAY_CHECK_INTERVAL 64
+#endif
 
 /*******************************************************************************
 * Opaque data structures
@@ -27,61 +107,415 @@ typedef enum _active
     IN_USE,
 } _active;
 
+/* Slot state is kept in the index rather than in a header in front of each
+ * object.  Scanning for free slots or empty chunks therefore never touches the
+ * pages holding the objects themselves, and relocating an object is a plain
+ * copy of its payload. */
 typedef struct _ab_t
 {
-    _active in_use;
-    uint8_t data[];
+    uint8_t *data;      /* object storage, NULL when not (or no longer) backed */
+    size_t   chunk;     /* owning chunk (chunk allocation only)               */
+    _active  in_use;
+    bool     pinned;
 } _ab_t;
 
+/* State only some configurations need is kept beside the index, one entry per slot, and only allocated for them. */
+typedef struct _free_link_t
+{
+    size_t prev;        /* free list links (LIFO placement only) */
+    size_t next;
+} _free_link_t;
+
+typedef enum _scrub_flag
+{
+    SCRUB_DIRTY   = 1,  /* free but not yet zeroed     */
+    SCRUB_QUEUED  = 2,  /* waiting in the scrub queue  */
+    SCRUB_STACKED = 4,  /* waiting on the clean stack  */
+} _scrub_flag;
+
+typedef struct _chunk_t
+{
+    uint8_t *block;     /* chunk storage as allocated                     */
+    uint8_t *memory;    /* first slot, NULL once the chunk is released    */
+    size_t   offset;    /* pool index of the chunk's first slot           */
+    size_t   count;     /* number of slots in the chunk                   */
+    size_t   active;    /* number of slots in use                         */
+    size_t   pinned;    /* number of pinned slots                         */
+    size_t   color;     /* cache lines the first slot is offset by        */
+    op_ll_lifetime_hint lifetime;   /* lifetime of hinted objects held, reset once empty */
+    uint64_t empty_since;           /* op_time_ms() when the chunk last became empty (decay only) */
+    size_t   block_bytes;           /* size of the mapping, 0 unless the chunk is mapped */
+    size_t   advised_bytes;         /* pages handed back to the kernel while empty    */
+    bool     advised;
+    uint8_t *states;                /* slot states in the file (persistent pools only) */
+    int      fd;                    /* file behind the mapping (clonable pools only) */
+    bool     cloned;                /* mapped copy-on-write since the pool was cloned */
+} _chunk_t;
+
 struct _op_allocator
 {
     size_t object_size;
+    size_t stride;          /* distance between slots, object_size unless padded */
     size_t initial_count;
     size_t maximum_objects;
+    size_t active_objects;
     bool   use_chunks;
     bool   use_linear;
     bool   initialized;
-    _ab_t   **pool;
+    op_allocator_config config;
+    _ab_t    *pool;
+    _chunk_t *chunks;
+    size_t    chunk_count;
+    size_t    free_head;    /* most recently freed slot (LIFO placement only) */
+    size_t    free_tail;
+    _free_link_t *free_links;   /* per slot (LIFO placement only) */
+    size_t    operations;   /* allocations and deallocations since the free list was last sorted */
+    size_t    next_color;
+    size_t   *scrub_queue;      /* ring of freed slots awaiting zeroing (deferred zeroing only) */
+    size_t    scrub_head;
+    size_t    scrub_count;
+    size_t   *clean_stack;      /* free slots known to be zeroed (deferred zeroing only)       */
+    size_t    clean_count;
+    size_t    scrub_capacity;
+    uint8_t  *scrub_flags;      /* _scrub_flag bits per slot (deferred zeroing only) */
+    size_t    dirty_objects;
+    size_t    inline_zeroings;
+    size_t    backed_objects;       /* slots whose memory exists                          */
+    size_t    available_low_water;  /* fewest backed free slots since the last maintenance */
+    size_t    growth_requests;
+    size_t    exhausted_allocations;
+    bool      growth_requested;
+    op_allocator reserve;       /* emergency pool past the capacity limits (OP_OVERFLOW_RESERVE only) */
+    void    **spilled;          /* objects from malloc past the capacity limits (OP_OVERFLOW_MALLOC only) */
+    size_t    spill_count;
+    size_t    spill_capacity;
+    size_t    capped_allocations;
+    op_allocator next_allocator;    /* registry of every initialized allocator, for the memory budget */
+    bool      keep_on_trim;         /* never trimmed under memory pressure (emergency reserves)         */
+    size_t    decay_operations;     /* operations since the last check for decayed chunks */
+    size_t    decayed_chunks;
+    size_t    advised_bytes;
+    bool      persistent;
+    int       persistent_fd;
+    struct _persistent_header_t *persistent_header;    /* mapped first page of the file */
+    size_t    persistent_end;       /* file offset at which the next chunk region goes */
+    struct _shared_header_t *shared;    /* the mapped segment (shared pools only) */
+    _Atomic uint32_t *shared_links;     /* next free slot plus one, per slot */
+    _Atomic uint8_t  *shared_states;
+    uint8_t  *shared_slots;
+    int       shared_fd;
+    _Atomic uint32_t trace_id;      /* 0 until the allocator is first traced */
 };
 
+/* The memory budget spans every allocator in the process, so allocators used by different threads all update it.
+ * The byte count, the watermarks and `above` are atomic so that allocations can compare them without the lock and
+ * only take it when a watermark is crossed.  Everything else, and every change to `above`, is guarded by the lock,
+ * which the thread holding it may take again from the allocators it trims.  The callback runs after the lock is
+ * released. */
+typedef struct _budget_t
+{
+    _Atomic size_t bytes;           /* bytes backing objects across all allocators             */
+    _Atomic size_t high_watermark;  /* 0 while no budget is set                                */
+    _Atomic size_t low_watermark;
+    op_pressure_callback callback;
+    void        *context;
+    _Atomic bool above;             /* crossed the high watermark, not yet back below the low one */
+    bool         checking;          /* trims and callbacks in progress must not recurse         */
+    op_allocator allocators;
+    size_t       cgroup_events;     /* memory.events high and max counts seen at the last poll */
+    bool         cgroup_polled;
+} _budget_t;
+
+static _budget_t memory_budget = { 0 };
+
+#if OP_CAN_THREAD
+static pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local bool budget_held = false;
+static _Thread_local bool budget_notifying = false;    /* in the callback, whose own allocations are not checked */
+#else
+static bool budget_notifying = false;
+#endif
+
+/* A snapshot file holds this header, one record per chunk, one state byte per slot and then the payload of every
+ * populated chunk, each starting on a page of its own so it can be mapped straight back in.  Integers are in the
+ * byte order of the machine that wrote the file. */
+typedef struct _snapshot_header_t
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t object_size;
+    uint64_t stride;
+    uint64_t initial_count;
+    uint64_t maximum_objects;
+    uint64_t chunk_count;
+    uint8_t  use_linear;
+    uint8_t  cache_coloring;
+    uint8_t  cache_line_padding;
+    uint8_t  io_buffers;
+    uint8_t  unused[4];
+} _snapshot_header_t;
+
+typedef struct _snapshot_chunk_t
+{
+    uint64_t offset;            /* pool index of the chunk's first slot             */
+    uint64_t count;
+    uint64_t color;
+    uint64_t lifetime;
+    uint64_t payload_offset;    /* file offset of the chunk's payload, 0 if released */
+    uint64_t payload_bytes;     /* page-rounded, the first slot following the color */
+} _snapshot_chunk_t;
+
+typedef enum _snapshot_state
+{
+    SNAPSHOT_FREE,
+    SNAPSHOT_IN_USE,
+    SNAPSHOT_PINNED,
+} _snapshot_state;
+
+/* A persistent pool file starts with a page holding this header, followed by one region per chunk in the order
+ * the chunks were added.  A region starts with a _persistent_chunk_t and the chunk's slot states, using the
+ * _snapshot_state values, and the slots follow on the next page boundary.  Only offsets are stored, so the file can be
+ * mapped at any address.  Every update to the file is ordered so that a crash leaves it consistent:
+ *   - an object is zeroed before its state byte says it is in use, and single bytes cannot tear;
+ *   - a new region is written out and synced before chunk_count is raised to include it. */
+typedef struct _persistent_header_t
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t object_size;
+    uint64_t initial_count;
+    uint64_t chunk_count;       /* regions committed to the file */
+    uint8_t  use_linear;
+    uint8_t  unused[7];
+} _persistent_header_t;
+
+typedef struct _persistent_chunk_t
+{
+    uint64_t offset;            /* pool index of the chunk's first slot           */
+    uint64_t count;
+    uint64_t payload_offset;    /* offset of the first slot from the region start */
+    uint64_t region_bytes;
+} _persistent_chunk_t;
+
+/* A shared pool segment holds this header, then a link and a state byte per slot, and the slots themselves from the
+ * first page boundary after those.  Every process maps the segment wherever it likes, so nothing in it is a pointer.
+ * Free slots form a lock-free stack whose top packs the slot index plus one with a tag that changes on every push and
+ * pop, so a slot popped and pushed back in between cannot fool a compare-and-swap.  Slots never handed out yet are
+ * taken from the untouched count instead, so a new segment needs no initialization beyond this header. */
+typedef struct _shared_header_t
+{
+    _Atomic uint32_t ready;     /* set to 1, with release order, once everything after it is written */
+    char     magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t object_size;
+    uint64_t capacity;
+    uint64_t segment_bytes;
+    uint64_t payload_offset;    /* offset of the first slot from the segment start */
+    _Atomic uint64_t free_top;  /* tag << 32 | (index + 1), or a tag alone when empty */
+    _Atomic uint64_t untouched; /* index of the first slot never handed out */
+    _Atomic uint64_t active;
+} _shared_header_t;
+
+/* a run of a chunk's slots initialized by one thread */
+typedef struct _slice_t
+{
+    op_allocator allocator;
+    _chunk_t    *chunk;
+    size_t       first;
+    size_t       last;
+    bool         zero;      /* the memory came from malloc rather than calloc */
+} _slice_t;
+
+typedef struct _free_entry_t
+{
+    uint8_t *data;
+    size_t   index;
+} _free_entry_t;
+
+#if OP_CAN_TRACE
+/* Each thread owns one ring and is its only writer.  Whoever holds `flushing` is its only reader, which is either the
+ * owner, when the ring is full, or op_ll_trace_flush(). */
+typedef struct _trace_ring_t
+{
+    _Atomic uint64_t head;          /* records ever written */
+    _Atomic uint64_t tail;          /* records ever flushed or discarded */
+    uint64_t         limit;         /* head the owner may write up to before it reads tail again */
+    atomic_flag      flushing;
+    uint32_t         thread;
+    struct _trace_ring_t *next;
+    op_trace_record  records[OP_TRACE_RING_RECORDS];
+} _trace_ring_t;
+
+typedef struct _trace_t
+{
+    _Atomic bool     active;
+    _Atomic int      fd;
+    _Atomic uint64_t offset;        /* where the next batch of records goes in the file */
+    _Atomic uint64_t records;
+    _Atomic uint64_t dropped;
+    _Atomic bool     failed;        /* a write came up short */
+    _Atomic uint32_t next_thread;
+    _Atomic uint32_t next_allocator;
+    _trace_ring_t *_Atomic rings;
+    op_trace_header  header;
+} _trace_t;
+
+static _trace_t trace_state = { .fd = -1 };
+static _Thread_local _trace_ring_t *trace_ring = NULL;
+#endif
+
+/*******************************************************************************
+* Static helper function declarations
+*******************************************************************************/
+
+static bool fill_chunks(op_allocator allocator, const size_t offset, const size_t object_count);
+static bool populate_chunk(op_allocator allocator, _chunk_t *chunk);
+static void release_chunk(op_allocator allocator, _chunk_t *chunk);
+static size_t count_init_threads(const op_allocator allocator, const _chunk_t *chunk);
+static void prepare_chunk(op_allocator allocator, _chunk_t *chunk, const size_t threads);
+static void *prepare_slots(void *slice);
+static bool retire_chunk(op_allocator allocator, _chunk_t *chunk);
+static bool map_persistent_chunk(op_allocator allocator, _chunk_t *chunk);
+static bool load_persistent_chunks(op_allocator allocator);
+static void abandon_persistent_file(const char *path, const int fd, const bool created);
+static op_allocator map_shared(int fd, const char *name);
+static int create_anonymous_file(void);
+static bool clone_chunk(_chunk_t *original, _chunk_t *copy);
+static void *allocate_shared(op_allocator allocator);
+static void deallocate_shared(op_allocator allocator, const void *object);
+static size_t find_shared_slot(const op_allocator allocator, const void *object);
+static bool write_fully(int fd, const void *buffer, size_t size);
+static bool write_zeroes(int fd, size_t size);
+static bool read_fully(int fd, void *buffer, size_t size);
+static void advise_chunk(op_allocator allocator, _chunk_t *chunk);
+static void wake_chunk(op_allocator allocator, _chunk_t *chunk);
+static void release_object(op_allocator allocator, const size_t index);
+static size_t page_size(void);
+static size_t object_alignment(const op_allocator allocator);
+static void swap_objects(uint8_t *a, uint8_t *b, size_t size);
+static bool grow_pool(op_allocator allocator);
+static size_t pool_limit(const op_allocator allocator);
+static void *allocate_overflow(op_allocator allocator);
+static bool release_overflow(op_allocator allocator, const void *object);
+static void register_allocator(op_allocator allocator);
+static void unregister_allocator(op_allocator allocator);
+static size_t trim_allocators(void);
+static void check_memory_budget(void);
+static bool lock_budget(void);
+static void unlock_budget(const bool taken);
+static void notify_pressure(op_pressure_callback callback, void *context, const op_ll_pressure_level level);
+static bool read_memory_pressure(const double psi_threshold);
+static bool claim_slot(op_allocator allocator, const size_t index);
+static void vacate_slot(op_allocator allocator, const size_t index);
+static size_t find_slot(const op_allocator allocator, const void *object);
+static size_t find_free_slot(const op_allocator allocator);
+static size_t find_free_slot_in_chunk(const op_allocator allocator, const _chunk_t *chunk);
+static size_t find_backed_free_slot(const op_allocator allocator);
+static void push_free_slot(op_allocator allocator, const size_t index, const bool recent);
+static void unlink_free_slot(op_allocator allocator, const size_t index);
+static void relocate_slot(op_allocator allocator, const size_t from, const size_t to,
+                          op_relocate_callback relocate, void *context);
+static int compare_chunk_occupancy(const void *a, const void *b);
+static void evacuate_chunks(op_allocator allocator, _chunk_t **order, const size_t populated,
+                            op_relocate_callback relocate, void *context);
+static size_t find_hinted_slot(const op_allocator allocator, const op_ll_lifetime_hint hint, const bool backed);
+static bool resize_slot_state(op_allocator allocator, const size_t capacity);
+static int compare_free_entry_address(const void *a, const void *b);
+static void count_operation(op_allocator allocator);
+static void occupy_slot(op_allocator allocator, const size_t index);
+static bool back_slot(op_allocator allocator, const size_t index);
+static void note_availability(op_allocator allocator);
+static bool resize_scrub_space(op_allocator allocator, const size_t capacity);
+static bool is_dirty(const op_allocator allocator, const size_t index);
+static void mark_clean(op_allocator allocator, const size_t index);
+static void push_clean_slot(op_allocator allocator, const size_t index);
+static size_t pop_clean_slot(op_allocator allocator);
+static void scrub_object(uint8_t *object, const size_t size);
+#if OP_CAN_TRACE
+static void trace(op_allocator allocator, const op_trace_event event, const size_t slot) __attribute((noinline));
+static _trace_ring_t *attach_trace_ring(void);
+static void drain_trace_ring(_trace_ring_t *ring);
+static uint64_t trace_ticks(void);
+static uint64_t trace_ns(void);
+#endif
+
 /*******************************************************************************
 * Low-level API function definitions
 *******************************************************************************/
 
 void *op_ll_allocate_object(op_allocator allocator)
+{
+    return op_ll_allocate_object_hint(allocator, OP_HINT_NONE);
+}
+
+void *op_ll_allocate_object_hint(op_allocator allocator, const op_ll_lifetime_hint hint)
 {
     void *rv = NULL;
 
-    if (allocator && allocator->initialized)
+    if (allocator && allocator->initialized && allocator->shared)
+    {
+        rv = allocate_shared(allocator);
+    }
+    else if (allocator && allocator->initialized)
     {
+        size_t i;
+        bool hinted = allocator->use_chunks && hint != OP_HINT_NONE;
 retry:
-        for (size_t i = 0; i < allocator->maximum_objects; i++)
+        if (hinted)
         {
-            if (allocator->pool[i] == NULL)
+            /* backing memory is left to op_ll_maintain(), so with bounded latency only backed chunks will do */
+            i = find_hinted_slot(allocator, hint, allocator->config.bounded_latency);
+            if (i == NO_SLOT && allocator->maximum_objects >= pool_limit(allocator))
             {
-                allocator->pool[i] = calloc(1, sizeof(_ab_t) + allocator->object_size);
-                if (allocator->pool[i])
-                {
-                    rv = allocator->pool[i]->data;
-                    memset(rv, 0, allocator->object_size);
-                    allocator->pool[i]->in_use = IN_USE;
-                    break;
-                }
-                else
+                /* the pool cannot grow to keep this lifetime apart, so share a chunk rather than fail */
+                i = find_free_slot(allocator);
+            }
+        }
+        else if (!allocator->config.deferred_zeroing || (i = pop_clean_slot(allocator)) == NO_SLOT)
+        {
+            i = find_free_slot(allocator);
+        }
+        if (i != NO_SLOT && allocator->config.bounded_latency && allocator->pool[i].data == NULL)
+        {
+            i = find_backed_free_slot(allocator);   /* backing memory is left to op_ll_maintain() */
+        }
+
+        if (i != NO_SLOT)
+        {
+            /* only an empty chunk takes on the hint; a shared one keeps the lifetime it already has */
+            _chunk_t *chunk = allocator->use_chunks ? &allocator->chunks[allocator->pool[i].chunk] : NULL;
+            bool label = hinted && chunk->active == 0;
+            if (claim_slot(allocator, i))
+            {
+                if (label)
                 {
-                    op_error_handler(__FILE__, __LINE__, "Could not allocate desired object.");
+                    chunk->lifetime = hint;
                 }
+                rv = allocator->pool[i].data;
+                count_operation(allocator);
+                TRACE(allocator, OP_TRACE_ALLOCATE, i);
             }
-            else if (allocator->pool[i]->in_use == NOT_IN_USE)
+        }
+        else if (allocator->active_objects == allocator->maximum_objects
+                 && allocator->maximum_objects >= pool_limit(allocator))
+        {
+            allocator->capped_allocations++;
+            rv = allocate_overflow(allocator);
+            if (rv)
             {
-                rv = allocator->pool[i]->data;
-                memset(rv, 0, allocator->object_size);
-                allocator->pool[i]->in_use = IN_USE;
-                break;
+                TRACE(allocator, OP_TRACE_ALLOCATE, NO_SLOT);
             }
         }
-
-        if (rv == NULL)
+        else if (allocator->config.bounded_latency)
+        {
+            /* growing here would put a system call on the allocation path; op_ll_maintain() does it instead */
+            allocator->exhausted_allocations++;
+            op_error_handler(__FILE__, __LINE__, "Allocation pool exhausted before maintenance could grow it.");
+        }
+        else
         {
             if (grow_pool(allocator))
             {
@@ -93,6 +527,8 @@ retry:
                 op_error_handler(__FILE__, __LINE__, "Unable to grow allocation pool.");
             }
         }
+        note_availability(allocator);
+        check_memory_budget();
     }
     else
     {
@@ -107,18 +543,60 @@ retry:
     return rv;
 }
 
-void op_ll_deallocate_object(const op_allocator allocator, const void *object)
+void *op_ll_allocate_near(op_allocator allocator, const void *neighbor)
 {
-    if (allocator != NULL && object != NULL)
+    void *rv = NULL;
+
+    size_t n = allocator && allocator->initialized && allocator->use_chunks && neighbor
+               ? find_slot(allocator, neighbor) : NO_SLOT;
+    if (n != NO_SLOT)
     {
-        for (size_t i = 0; i < allocator->maximum_objects; i++)
+        /* the closest free slot of the neighbor's chunk is also the closest in memory */
+        const _chunk_t *chunk = &allocator->chunks[allocator->pool[n].chunk];
+        size_t i = NO_SLOT;
+        for (size_t distance = 1; i == NO_SLOT && distance < chunk->count; distance++)
         {
-            if (allocator->pool[i]->data == object)
+            if (n >= chunk->offset + distance && allocator->pool[n - distance].in_use == NOT_IN_USE)
+            {
+                i = n - distance;
+            }
+            else if (n + distance < chunk->offset + chunk->count && allocator->pool[n + distance].in_use == NOT_IN_USE)
             {
-                allocator->pool[i]->in_use = NOT_IN_USE;
-                return;
+                i = n + distance;
             }
         }
+        if (i != NO_SLOT && claim_slot(allocator, i))
+        {
+            rv = allocator->pool[i].data;
+            count_operation(allocator);
+            note_availability(allocator);
+            TRACE(allocator, OP_TRACE_ALLOCATE, i);
+            check_memory_budget();
+        }
+    }
+
+    return rv ? rv : op_ll_allocate_object(allocator);
+}
+
+void op_ll_deallocate_object(const op_allocator allocator, const void *object)
+{
+    if (allocator != NULL && object != NULL && allocator->shared)
+    {
+        deallocate_shared(allocator, object);
+    }
+    else if (allocator != NULL && object != NULL)
+    {
+        size_t i = find_slot(allocator, object);
+        if (i < allocator->maximum_objects && allocator->pool[i].in_use == IN_USE)
+        {
+            vacate_slot(allocator, i);
+            count_operation(allocator);
+            TRACE(allocator, OP_TRACE_DEALLOCATE, i);
+        }
+        else if (i == NO_SLOT && release_overflow(allocator, object))
+        {
+            TRACE(allocator, OP_TRACE_DEALLOCATE, NO_SLOT);
+        }
     }
     else
     {
@@ -126,203 +604,3105 @@ void op_ll_deallocate_object(const op_allocator allocator, const void *object)
     }
 }
 
-void op_ll_deinitialize_allocator(op_allocator allocator)
+void op_ll_pin_object(op_allocator allocator, const void *object, const bool pinned)
+{
+    size_t i = allocator != NULL && object != NULL ? find_slot(allocator, object) : NO_SLOT;
+    if (allocator != NULL && i < allocator->maximum_objects && allocator->pool[i].in_use == IN_USE)
+    {
+        if (allocator->pool[i].pinned != pinned)
+        {
+            allocator->pool[i].pinned = pinned;
+            if (allocator->use_chunks)
+            {
+                _chunk_t *chunk = &allocator->chunks[allocator->pool[i].chunk];
+                if (pinned) { chunk->pinned++; }
+                else        { chunk->pinned--; }
+                if (chunk->states) { chunk->states[i - chunk->offset] = pinned ? SNAPSHOT_PINNED : SNAPSHOT_IN_USE; }
+            }
+        }
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "Attempted to pin an object not allocated from this allocator.");
+    }
+}
+
+size_t op_ll_compact(op_allocator allocator, op_relocate_callback relocate, void *context)
 {
+    size_t rv = 0;
+
     if (allocator && allocator->initialized)
     {
-        allocator->initialized = false;
-        if (allocator->use_chunks)
+        if (allocator->persistent)
+        {
+            /* relocation could not be made crash-consistent, and regions of the file are never given back */
+        }
+        else if (allocator->use_chunks)
         {
-            if (allocator->use_linear)
+            _chunk_t **order = malloc(allocator->chunk_count * sizeof(_chunk_t *));
+            if (order)
             {
-                /* this allocator is chunked and uses groups of initial_count allocations */
-                for (size_t i = 0; i < allocator->maximum_objects; i += allocator->initial_count)
+                /* Objects are only concentrated among chunks of the same lifetime so that segregation holds.  Buffer
+                 * chunks are never released, and their buffers may be in flight, so moving them would gain nothing. */
+                const op_ll_lifetime_hint lifetimes[] = { OP_HINT_NONE, OP_HINT_SHORT_LIVED, OP_HINT_LONG_LIVED };
+                bool movable = relocate != NULL && !allocator->config.io_buffers;
+                for (size_t l = 0; movable && l < sizeof(lifetimes) / sizeof(lifetimes[0]); l++)
                 {
-                    free(allocator->pool[i]);
+                    size_t populated = 0;
+                    for (size_t c = 0; c < allocator->chunk_count; c++)
+                    {
+                        if (allocator->chunks[c].memory != NULL && allocator->chunks[c].lifetime == lifetimes[l])
+                        {
+                            order[populated++] = &allocator->chunks[c];
+                        }
+                    }
+                    evacuate_chunks(allocator, order, populated, relocate, context);
+                }
+                free(order);
+
+                for (size_t c = 0; c < allocator->chunk_count; c++)
+                {
+                    if (allocator->chunks[c].memory != NULL && allocator->chunks[c].active == 0
+                            && !allocator->chunks[c].advised)
+                    {
+                        rv += retire_chunk(allocator, &allocator->chunks[c]);
+                    }
                 }
             }
             else
             {
-                /* this allocator is chunked and uses the doubling allocation scheme */
-                free(allocator->pool[0]);   /* delete the first chunk of initial_count */
-                /* each subsequent chunk starts at doublings from initial_count */
-                for (size_t i = allocator->initial_count; i < allocator->maximum_objects; i <<= 1)
-                {
-                    free(allocator->pool[i]);
-                }
+                op_error_handler(__FILE__, __LINE__, "Could not allocate working space for compaction.");
             }
         }
         else
         {
+            /* individually allocated objects cannot be concentrated, but unused ones can be handed back */
             for (size_t i = 0; i < allocator->maximum_objects; i++)
             {
-                free(allocator->pool[i]);   /* it's OK to free a NULL, and we initialize to NULL */
+                if (allocator->pool[i].data != NULL && allocator->pool[i].in_use == NOT_IN_USE)
+                {
+                    release_object(allocator, i);
+                    if (allocator->config.placement == OP_PLACE_LIFO)
+                    {
+                        unlink_free_slot(allocator, i);
+                        push_free_slot(allocator, i, false);
+                    }
+                    rv++;
+                }
             }
         }
-        free(allocator->pool);
-        free(allocator);
+        check_memory_budget();
     }
     else
     {
-        op_error_handler(__FILE__, __LINE__, "Attempted to deinitialize an allocator that was not initialized.");
+        op_error_handler(__FILE__, __LINE__, "Attempted to compact an uninitialized allocator.");
     }
-}
 
-op_allocator_stats op_ll_get_allocator_stats(const op_allocator allocator)
-{
-    op_allocator_stats rv = { 0 };
-    if (allocator != NULL && allocator->initialized)
-    {
-        rv.object_size = allocator->object_size;
-        rv.maximum_objects = allocator->maximum_objects;
-        rv.active_objects = 0;
-        for (size_t i = 0; i < allocator->maximum_objects && allocator->pool[i] != NULL; i++)
-        {
-            if (allocator->pool[i]->in_use == IN_USE) { rv.active_objects++; }
-        }
-    }
     return rv;
 }
 
-op_allocator op_ll_initialize_allocator(const size_t object_size, const size_t initial_count,
-                                        const op_ll_allocator_mode mode)
+size_t op_ll_decay(op_allocator allocator)
 {
-    bool use_chunks = false, use_linear = false;
-    switch (mode)
-    {
-    case OP_DOUBLING_INDIVIDUAL:
-        use_chunks = false;
-        use_linear = false;
-        break;
-
-    case OP_DOUBLING_CHUNK:
-        use_chunks = true;
-        use_linear = false;
-        break;
-
-    case OP_LINEAR_INDIVIDUAL:
-        use_chunks = false;
-        use_linear = true;
-        break;
+    size_t rv = 0;
 
-    case OP_LINEAR_CHUNK:
-        use_chunks = true;
-        use_linear = true;
-        break;
-    };
-
-    op_allocator rv = calloc(1, sizeof(struct _op_allocator));
-    if (rv)
+    if (allocator && allocator->initialized)
     {
-        /* set the allocator configuration */
-        rv->object_size = object_size;
-        rv->initial_count = rv->maximum_objects = initial_count;
-        rv->use_chunks = use_chunks;
-        rv->use_linear = use_linear;
-        rv->initialized = true;
-
-        /* allocate the space for the object pool itself. */
-        if ((rv->pool = calloc(rv->maximum_objects, sizeof(_ab_t *))))
+        allocator->decay_operations = 0;
+        if (allocator->use_chunks && allocator->config.decay_ms > 0)
         {
-            if (use_chunks)
+            uint64_t now = op_time_ms();
+            for (size_t c = 0; c < allocator->chunk_count; c++)
             {
-                if (!fill_chunks(rv, 0, rv->maximum_objects))
+                _chunk_t *chunk = &allocator->chunks[c];
+                if (chunk->memory != NULL && chunk->active == 0 && !chunk->advised
+                        && now - chunk->empty_since >= allocator->config.decay_ms)
                 {
-                    free(rv->pool);
-                    free(rv);
-                    rv = NULL;
+                    rv += retire_chunk(allocator, chunk);
                 }
             }
-        }
-        else
-        {
-            free(rv);
-            rv = NULL;
-            op_error_handler(__FILE__, __LINE__, "Could not allocate internal space for allocator.");
+            allocator->decayed_chunks += rv;
+            check_memory_budget();
         }
     }
     else
     {
-        op_error_handler(__FILE__, __LINE__, "Could not allocate space for allocator handle.");
+        op_error_handler(__FILE__, __LINE__, "Attempted to decay an uninitialized allocator.");
     }
 
     return rv;
 }
 
-/*******************************************************************************
-* Static helper function definitions
-*******************************************************************************/
-
-static bool fill_chunks(op_allocator allocator, const size_t offset, const size_t object_count)
+size_t op_ll_scrub(op_allocator allocator, const size_t budget)
 {
-    bool rv = true;
+    size_t rv = 0;
 
-    size_t entry_size = sizeof(_ab_t) + allocator->object_size;
-    size_t chunk_size = object_count * entry_size;
-    uint8_t *chunk;
-    chunk = calloc(object_count, chunk_size);
-    if (chunk)
+    if (allocator && allocator->initialized)
     {
-        for (size_t i = 0; i < object_count; i++)
+        while (rv < budget && allocator->scrub_count > 0)
         {
-            allocator->pool[i + offset] = (_ab_t *) &chunk[i * entry_size];
+            size_t i = allocator->scrub_queue[allocator->scrub_head];
+            allocator->scrub_head = (allocator->scrub_head + 1) % allocator->scrub_capacity;
+            allocator->scrub_count--;
+
+            allocator->scrub_flags[i] &= ~SCRUB_QUEUED;
+            if (is_dirty(allocator, i))
+            {
+                scrub_object(allocator->pool[i].data, allocator->object_size);
+                mark_clean(allocator, i);
+                push_clean_slot(allocator, i);
+                rv++;
+            }
         }
     }
     else
     {
-        op_error_handler(__FILE__, __LINE__, "Could not fill chunks when initializing or expanding.");
-        rv = false;
+        op_error_handler(__FILE__, __LINE__, "Attempted to scrub an uninitialized allocator.");
     }
 
     return rv;
 }
 
-static bool grow_pool(op_allocator allocator)
+bool op_ll_maintain(op_allocator allocator)
 {
     bool rv = false;
 
-    size_t old_size = allocator->maximum_objects;
-    size_t new_size, grow_size;
-    if (allocator->use_linear)
+    if (allocator && allocator->initialized && allocator->shared)
     {
-        grow_size = allocator->initial_count;
-        new_size = old_size + grow_size;
+        rv = true;      /* the whole segment is reserved when the pool is created */
     }
-    else
+    else if (allocator && allocator->initialized)
     {
-        grow_size = old_size;
-        new_size = old_size * 2;
-    }
+        size_t target = allocator->config.high_watermark > allocator->config.low_watermark
+                        ? allocator->config.high_watermark : allocator->config.low_watermark;
+        if (target == 0)
+        {
+            target = 1;     /* with no watermarks set, maintenance still makes room for the next allocation */
+        }
 
-    allocator->pool = realloc(allocator->pool, sizeof(_ab_t *) * new_size);
-    if (allocator->pool)
-    {
-        /* we use the for loop here because valgrind is too stupid to figure out memset */
-        for (size_t i = old_size; i < new_size; i++)
+        /* work the allocation path left due is done first, so memory decay releases counts towards the target */
+        if (allocator->config.free_list_sort_interval > 0
+                && allocator->operations >= allocator->config.free_list_sort_interval)
         {
-            allocator->pool[i] = NULL;
+            op_ll_optimize_free_list(allocator);
         }
-        allocator->maximum_objects = new_size;
-        if (allocator->use_chunks)
+        if (allocator->config.decay_ms > 0 && allocator->decay_operations >= OP_DECAY_CHECK_INTERVAL)
         {
-            rv = fill_chunks(allocator, old_size, grow_size);
+            op_ll_decay(allocator);
         }
-        else
+
+        /* Memory released by compaction is backed again before the pool is grown.  The cursor only moves forward, so
+         * newly grown slots are picked up after the existing ones. */
+        rv = true;
+        size_t cursor = 0;
+        while (rv && allocator->backed_objects - allocator->active_objects < target)
         {
-            rv = true;
+            if (allocator->use_chunks && cursor < allocator->chunk_count)
+            {
+                _chunk_t *chunk = &allocator->chunks[cursor++];
+                if (chunk->memory == NULL)
+                {
+                    rv = populate_chunk(allocator, chunk);
+                }
+            }
+            else if (!allocator->use_chunks && cursor < allocator->maximum_objects)
+            {
+                size_t i = cursor++;
+                if (allocator->pool[i].in_use == NOT_IN_USE && allocator->pool[i].data == NULL)
+                {
+                    rv = back_slot(allocator, i);
+                }
+            }
+            else
+            {
+                rv = grow_pool(allocator);
+            }
+        }
+
+        if (rv)
+        {
+            allocator->growth_requested = false;
         }
+        allocator->available_low_water = allocator->backed_objects - allocator->active_objects;
+        check_memory_budget();
     }
     else
     {
-        op_error_handler(__FILE__, __LINE__, "Could not realloc while growing pool.");
+        op_error_handler(__FILE__, __LINE__, "Attempted to maintain an uninitialized allocator.");
     }
 
     return rv;
 }
 
-/*******************************************************************************
-* Weakly-linked function implementations.
-*******************************************************************************/
+bool op_ll_growth_pending(const op_allocator allocator)
+{
+    /* shared pools never grow, so they never leave the flag set */
+    return allocator != NULL && allocator->initialized && allocator->growth_requested;
+}
+
+void op_ll_optimize_free_list(op_allocator allocator)
+{
+    if (allocator && allocator->initialized)
+    {
+        allocator->operations = 0;
+        if (allocator->config.placement == OP_PLACE_LIFO && allocator->active_objects < allocator->maximum_objects)
+        {
+            size_t free_count = allocator->maximum_objects - allocator->active_objects, backed = 0;
+            _free_entry_t *entries = malloc(free_count * sizeof(_free_entry_t));
+            if (entries)
+            {
+                for (size_t i = allocator->free_head; i != NO_SLOT; i = allocator->free_links[i].next)
+                {
+                    if (allocator->pool[i].data != NULL)
+                    {
+                        entries[backed++] = (_free_entry_t) { .data = allocator->pool[i].data, .index = i };
+                    }
+                }
+                qsort(entries, backed, sizeof(_free_entry_t), compare_free_entry_address);
+
+                /* backed slots in address order, then the unbacked ones in index order */
+                size_t unbacked = backed;
+                for (size_t i = 0; i < allocator->maximum_objects; i++)
+                {
+                    if (allocator->pool[i].in_use == NOT_IN_USE && allocator->pool[i].data == NULL)
+                    {
+                        entries[unbacked++].index = i;
+                    }
+                }
+                allocator->free_head = allocator->free_tail = NO_SLOT;
+                for (size_t e = 0; e < unbacked; e++)
+                {
+                    push_free_slot(allocator, entries[e].index, false);
+                }
+                free(entries);
+            }
+            else
+            {
+                op_error_handler(__FILE__, __LINE__, "Could not allocate working space for sorting the free list.");
+            }
+        }
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "Attempted to optimize an uninitialized allocator.");
+    }
+}
+
+#if OP_HAVE_IOVEC
+bool op_ll_allocate_iovec(op_allocator allocator, struct iovec *iov, const size_t count)
+{
+    size_t allocated = 0;
+
+    if (iov != NULL)
+    {
+        while (allocated < count && (iov[allocated].iov_base = op_ll_allocate_object(allocator)) != NULL)
+        {
+            iov[allocated++].iov_len = allocator->object_size;
+        }
+        if (allocated < count)
+        {
+            op_ll_deallocate_iovec(allocator, iov, allocated);  /* all or nothing */
+        }
+    }
+
+    return allocated == count;
+}
+
+void op_ll_deallocate_iovec(op_allocator allocator, const struct iovec *iov, const size_t count)
+{
+    for (size_t i = 0; iov != NULL && i < count; i++)
+    {
+        op_ll_deallocate_object(allocator, iov[i].iov_base);
+    }
+}
+
+size_t op_ll_chunk_regions(const op_allocator allocator, struct iovec *regions, const size_t capacity)
+{
+    size_t rv = allocator != NULL && allocator->initialized && allocator->use_chunks ? allocator->chunk_count : 0;
+
+    for (size_t c = 0; regions != NULL && c < rv && c < capacity; c++)
+    {
+        const _chunk_t *chunk = &allocator->chunks[c];
+        regions[c].iov_base = chunk->memory;
+        regions[c].iov_len = chunk->memory ? chunk->count * allocator->stride : 0;
+    }
+
+    return rv;
+}
+#endif
+
+size_t op_ll_object_region(const op_allocator allocator, const void *object)
+{
+    size_t i = allocator != NULL && allocator->initialized && allocator->use_chunks && object != NULL
+               ? find_slot(allocator, object) : NO_SLOT;
+    return i != NO_SLOT ? allocator->pool[i].chunk : OP_NO_HANDLE;
+}
+
+size_t op_ll_object_handle(const op_allocator allocator, const void *object)
+{
+    if (allocator != NULL && allocator->initialized && allocator->shared)
+    {
+        return object != NULL ? find_shared_slot(allocator, object) : OP_NO_HANDLE;
+    }
+
+    size_t i = allocator != NULL && allocator->initialized && object != NULL ? find_slot(allocator, object) : NO_SLOT;
+    return i != NO_SLOT && allocator->pool[i].in_use == IN_USE ? i : OP_NO_HANDLE;
+}
+
+void *op_ll_object_from_handle(const op_allocator allocator, const size_t handle)
+{
+    if (allocator != NULL && allocator->initialized && allocator->shared)
+    {
+        return handle < allocator->shared->capacity && atomic_load(&allocator->shared_states[handle]) == IN_USE
+               ? allocator->shared_slots + handle * allocator->stride : NULL;
+    }
+
+    return allocator != NULL && allocator->initialized && handle < allocator->maximum_objects
+           && allocator->pool[handle].in_use == IN_USE ? allocator->pool[handle].data : NULL;
+}
+
+bool op_ll_snapshot(const op_allocator allocator, int fd)
+{
+    bool rv = false;
+
+#if OP_CAN_MAP
+    _snapshot_chunk_t *records = NULL;
+    uint8_t *states = NULL;
+    if (allocator && allocator->initialized && allocator->use_chunks)
+    {
+        records = calloc(allocator->chunk_count, sizeof(_snapshot_chunk_t));
+        states = malloc(allocator->maximum_objects);
+    }
+    if (records && states)
+    {
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        _snapshot_header_t header =
+        {
+            .magic = SNAPSHOT_MAGIC, .version = SNAPSHOT_VERSION, .page_size = page,
+            .object_size = allocator->object_size, .stride = allocator->stride,
+            .initial_count = allocator->initial_count, .maximum_objects = allocator->maximum_objects,
+            .chunk_count = allocator->chunk_count, .use_linear = allocator->use_linear,
+            .cache_coloring = allocator->config.cache_coloring,
+            .cache_line_padding = allocator->config.cache_line_padding, .io_buffers = allocator->config.io_buffers,
+        };
+
+        size_t metadata_bytes = sizeof(header) + allocator->chunk_count * sizeof(_snapshot_chunk_t)
+                                + allocator->maximum_objects;
+        size_t position = metadata_bytes;
+        for (size_t c = 0; c < allocator->chunk_count; c++)
+        {
+            const _chunk_t *chunk = &allocator->chunks[c];
+            records[c] = (_snapshot_chunk_t)
+            {
+                .offset = chunk->offset, .count = chunk->count, .color = chunk->color, .lifetime = chunk->lifetime,
+            };
+            if (chunk->memory != NULL)
+            {
+                position = (position + page - 1) / page * page;
+                records[c].payload_offset = position;
+                records[c].payload_bytes = (chunk->color * OP_CACHE_LINE_SIZE * allocator->config.cache_coloring
+                                            + chunk->count * allocator->stride + page - 1) / page * page;
+                position += records[c].payload_bytes;
+            }
+        }
+        for (size_t i = 0; i < allocator->maximum_objects; i++)
+        {
+            const _ab_t *slot = &allocator->pool[i];
+            states[i] = slot->in_use == NOT_IN_USE ? SNAPSHOT_FREE : slot->pinned ? SNAPSHOT_PINNED : SNAPSHOT_IN_USE;
+        }
+
+        rv = write_fully(fd, &header, sizeof(header))
+             && write_fully(fd, records, allocator->chunk_count * sizeof(_snapshot_chunk_t))
+             && write_fully(fd, states, allocator->maximum_objects);
+        position = metadata_bytes;
+
+        /* the payload is written in sequence, padded with zeroes, so the file descriptor need not be seekable */
+        for (size_t c = 0; rv && c < allocator->chunk_count; c++)
+        {
+            const _chunk_t *chunk = &allocator->chunks[c];
+            if (records[c].payload_offset != 0)
+            {
+                size_t color_bytes = chunk->color * OP_CACHE_LINE_SIZE * allocator->config.cache_coloring;
+                size_t slot_bytes = chunk->count * allocator->stride;
+                rv = write_zeroes(fd, records[c].payload_offset - position + color_bytes)
+                     && write_fully(fd, chunk->memory, slot_bytes)
+                     && write_zeroes(fd, records[c].payload_bytes - color_bytes - slot_bytes);
+                position = records[c].payload_offset + records[c].payload_bytes;
+            }
+        }
+        if (!rv)
+        {
+            op_error_handler(__FILE__, __LINE__, "Could not write allocator snapshot.");
+        }
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "Only initialized chunk allocators can be snapshotted.");
+    }
+    free(records);
+    free(states);
+#else
+    UNUSED(allocator);
+    UNUSED(fd);
+    op_error_handler(__FILE__, __LINE__, "Snapshots are not supported on this platform.");
+#endif
+
+    return rv;
+}
+
+op_allocator op_ll_restore(const char *path)
+{
+    op_allocator rv = NULL;
+
+#if OP_CAN_MAP
+    int fd = path ? open(path, O_RDONLY) : -1;
+    _snapshot_header_t header;
+    struct stat file;
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    /* everything read from the file is checked against its size before it is allocated for or mapped, so a truncated
+     * or corrupt snapshot fails here rather than faulting on first use */
+    if (fd >= 0 && fstat(fd, &file) == 0 && read_fully(fd, &header, sizeof(header))
+            && memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 && header.version == SNAPSHOT_VERSION
+            && header.page_size % page == 0 && header.object_size > 0 && header.stride >= header.object_size
+            && header.maximum_objects > 0 && header.chunk_count > 0
+            && (!header.io_buffers || header.stride % page == 0)
+            && header.chunk_count <= (uint64_t) file.st_size / sizeof(_snapshot_chunk_t)
+            && header.maximum_objects <= (uint64_t) file.st_size
+            && sizeof(header) + header.chunk_count * sizeof(_snapshot_chunk_t) + header.maximum_objects
+               <= (uint64_t) file.st_size
+            && (rv = calloc(1, sizeof(struct _op_allocator))))
+    {
+        /* the restored allocator starts from the default configuration, keeping only what shapes the layout */
+        rv->object_size = header.object_size;
+        rv->stride = header.stride;
+        rv->initial_count = header.initial_count;
+        rv->maximum_objects = header.maximum_objects;
+        rv->use_chunks = true;
+        rv->use_linear = header.use_linear;
+        rv->initialized = true;
+        rv->config = op_ll_default_allocator_config();
+        rv->config.cache_coloring = header.cache_coloring;
+        rv->config.cache_line_padding = header.cache_line_padding;
+        rv->config.io_buffers = header.io_buffers;
+        rv->free_head = rv->free_tail = NO_SLOT;
+        rv->next_color = header.chunk_count % OP_CACHE_COLORS;
+
+        _snapshot_chunk_t record;
+        uint64_t covered = 0;   /* chunks hold every slot exactly once, in order */
+        uint64_t metadata_bytes = sizeof(header) + header.chunk_count * sizeof(_snapshot_chunk_t)
+                                  + header.maximum_objects;
+        uint8_t *states = malloc(rv->maximum_objects);
+        bool valid = (rv->pool = calloc(rv->maximum_objects, sizeof(_ab_t)))
+                     && (rv->chunks = calloc(header.chunk_count, sizeof(_chunk_t))) && states;
+        for (size_t c = 0; valid && c < header.chunk_count; c++)
+        {
+            valid = read_fully(fd, &record, sizeof(record)) && record.offset == covered && record.count > 0
+                    && record.count <= rv->maximum_objects - covered && record.lifetime <= OP_HINT_LONG_LIVED
+                    && record.color < OP_CACHE_COLORS;
+            uint64_t color_bytes = record.color * OP_CACHE_LINE_SIZE * rv->config.cache_coloring;
+            valid = valid && (record.payload_offset == 0
+                              || (record.payload_offset % page == 0 && record.payload_offset >= metadata_bytes
+                                  && record.payload_bytes <= (uint64_t) file.st_size
+                                  && record.payload_offset <= (uint64_t) file.st_size - record.payload_bytes
+                                  && color_bytes < record.payload_bytes
+                                  && record.count <= (record.payload_bytes - color_bytes) / rv->stride));
+            covered += valid ? record.count : 0;
+            if (valid)
+            {
+                _chunk_t *chunk = &rv->chunks[rv->chunk_count++];
+                *chunk = (_chunk_t)
+                {
+                    .offset = record.offset, .count = record.count, .color = record.color,
+                    .lifetime = (op_ll_lifetime_hint) record.lifetime,
+                };
+                for (size_t i = 0; i < chunk->count; i++)
+                {
+                    rv->pool[i + chunk->offset].chunk = c;
+                }
+                if (record.payload_offset != 0)
+                {
+                    /* private mappings are copy-on-write, so the file is left as it was */
+                    void *block = mmap(NULL, record.payload_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                                       (off_t) record.payload_offset);
+                    valid = block != MAP_FAILED;
+                    if (valid)
+                    {
+                        chunk->block = block;
+                        chunk->block_bytes = record.payload_bytes;
+                        chunk->memory = chunk->block + chunk->color * OP_CACHE_LINE_SIZE * rv->config.cache_coloring;
+                        for (size_t i = 0; i < chunk->count; i++)
+                        {
+                            rv->pool[i + chunk->offset].data = &chunk->memory[i * rv->stride];
+                        }
+                        rv->backed_objects += chunk->count;
+                        memory_budget.bytes += chunk->count * rv->stride;
+                    }
+                }
+            }
+        }
+
+        valid = valid && covered == rv->maximum_objects && read_fully(fd, states, rv->maximum_objects);
+        for (size_t i = 0; valid && i < rv->maximum_objects; i++)
+        {
+            _ab_t *slot = &rv->pool[i];
+            if (states[i] == SNAPSHOT_FREE)
+            {
+                push_free_slot(rv, i, false);
+            }
+            else if (slot->data != NULL && states[i] <= SNAPSHOT_PINNED)
+            {
+                occupy_slot(rv, i);
+                if (states[i] == SNAPSHOT_PINNED)
+                {
+                    slot->pinned = true;
+                    rv->chunks[slot->chunk].pinned++;
+                }
+            }
+            else
+            {
+                valid = false;  /* live objects cannot sit in released chunks, nor can slots be in unknown states */
+            }
+        }
+        free(states);
+
+        if (valid)
+        {
+            register_allocator(rv);
+            check_memory_budget();
+        }
+        else
+        {
+            op_ll_deinitialize_allocator(rv);
+            rv = NULL;
+        }
+    }
+    if (rv == NULL)
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not restore allocator snapshot.");
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#else
+    UNUSED(path);
+    op_error_handler(__FILE__, __LINE__, "Snapshots are not supported on this platform.");
+#endif
+
+    return rv;
+}
+
+op_allocator op_ll_open_persistent(const char *path, const size_t object_size, const size_t initial_count,
+                                   const op_ll_allocator_mode mode)
+{
+    op_allocator rv = NULL;
+
+#if OP_CAN_MAP
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    int fd = -1;
+    bool created = false;
+    if (path && object_size > 0 && (mode == OP_DOUBLING_CHUNK || mode == OP_LINEAR_CHUNK))
+    {
+        /* only a pool with room for objects is created; an existing one keeps the layout it was created with */
+        fd = initial_count > 0 ? open(path, O_RDWR | O_CREAT | O_EXCL, 0600) : -1;
+        created = fd >= 0;
+        fd = created ? fd : open(path, O_RDWR);
+    }
+
+    /* a second allocator on the file would map the same slot states and free structures, so it is locked out */
+    bool locked = fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) == 0;
+    off_t size = locked ? lseek(fd, 0, SEEK_END) : -1;
+    bool usable = size == 0 ? initial_count > 0 && ftruncate(fd, (off_t) page) == 0 : size >= (off_t) page;
+    _persistent_header_t *header = usable ? mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (header != MAP_FAILED && size == 0)
+    {
+        *header = (_persistent_header_t)
+        {
+            .magic = PERSISTENT_MAGIC, .version = PERSISTENT_VERSION, .page_size = page,
+            .object_size = object_size, .initial_count = initial_count, .use_linear = mode == OP_LINEAR_CHUNK,
+        };
+        msync(header, page, MS_SYNC);
+    }
+    if (header != MAP_FAILED && memcmp(header->magic, PERSISTENT_MAGIC, sizeof(header->magic)) == 0
+            && header->version == PERSISTENT_VERSION && header->page_size == page
+            && header->object_size == object_size && header->initial_count > 0
+            && (rv = calloc(1, sizeof(struct _op_allocator))))
+    {
+        /* the layout comes from the file, so an existing pool keeps the growth it was created with */
+        rv->object_size = rv->stride = object_size;
+        rv->initial_count = header->initial_count;
+        rv->use_chunks = true;
+        rv->use_linear = header->use_linear;
+        rv->initialized = true;
+        rv->config = op_ll_default_allocator_config();
+        rv->free_head = rv->free_tail = NO_SLOT;
+        rv->persistent = true;
+        rv->persistent_fd = fd;
+        rv->persistent_header = header;
+        rv->persistent_end = page;
+
+        bool valid = load_persistent_chunks(rv);
+        if (valid && rv->chunk_count == 0)
+        {
+            /* a new file, or one whose first region was never committed */
+            rv->maximum_objects = rv->initial_count;
+            valid = (rv->pool = calloc(rv->maximum_objects, sizeof(_ab_t))) && fill_chunks(rv, 0, rv->maximum_objects);
+            for (size_t i = 0; valid && i < rv->maximum_objects; i++)
+            {
+                push_free_slot(rv, i, false);
+            }
+        }
+        if (valid)
+        {
+            register_allocator(rv);
+            check_memory_budget();
+        }
+        else
+        {
+            if (size == 0)
+            {
+                abandon_persistent_file(path, fd, created);
+            }
+            op_ll_deinitialize_allocator(rv);
+            rv = NULL;
+            fd = -1;
+        }
+    }
+    else if (header != MAP_FAILED)
+    {
+        munmap(header, page);
+    }
+    if (rv == NULL)
+    {
+        if (fd >= 0 && locked && size == 0)
+        {
+            abandon_persistent_file(path, fd, created);
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        op_error_handler(__FILE__, __LINE__, locked || fd < 0 ? "Could not open persistent pool."
+                         : "Persistent pool is already open.");
+    }
+#else
+    UNUSED(path);
+    UNUSED(object_size);
+    UNUSED(initial_count);
+    UNUSED(mode);
+    op_error_handler(__FILE__, __LINE__, "Persistent pools are not supported on this platform.");
+#endif
+
+    return rv;
+}
+
+bool op_ll_sync(const op_allocator allocator)
+{
+    bool rv = allocator != NULL && allocator->initialized;
+
+#if OP_CAN_MAP
+    if (rv && allocator->persistent)
+    {
+        /* regions first, so that the header never refers to anything that is not on disk */
+        for (size_t c = 0; rv && c < allocator->chunk_count; c++)
+        {
+            rv = msync(allocator->chunks[c].block, allocator->chunks[c].block_bytes, MS_SYNC) == 0;
+        }
+        rv = rv && msync(allocator->persistent_header, allocator->persistent_header->page_size, MS_SYNC) == 0;
+    }
+#endif
+    if (!rv)
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not sync persistent pool.");
+    }
+
+    return rv;
+}
+
+op_allocator op_ll_create_shared(const char *name, const size_t object_size, const size_t capacity)
+{
+    op_allocator rv = NULL;
+
+#if OP_CAN_MAP
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    /* the links and states, then the payload, each rounded up to whole pages, must not overflow a size_t */
+    bool sized = object_size > 0 && capacity > 0 && capacity < UINT32_MAX
+                 && capacity <= (SIZE_MAX - sizeof(_shared_header_t) - page) / (sizeof(uint32_t) + 1);
+    size_t payload_offset = sized
+                            ? (sizeof(_shared_header_t) + capacity * (sizeof(uint32_t) + 1) + page - 1) / page * page
+                            : 0;
+    sized = sized && object_size <= (SIZE_MAX - payload_offset - page) / capacity;
+    size_t segment_bytes = sized ? payload_offset + (capacity * object_size + page - 1) / page * page : 0;
+    int fd = !sized || segment_bytes > (size_t) INT64_MAX ? -1
+             : name ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600) : create_anonymous_file();
+
+    /* the segment reads as zero, so only the header needs writing; the ready word goes last to publish it */
+    _shared_header_t *header = fd >= 0 && ftruncate(fd, (off_t) segment_bytes) == 0
+                               ? mmap(NULL, page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (header != MAP_FAILED)
+    {
+        memcpy(header->magic, SHARED_MAGIC, sizeof(header->magic));
+        header->version = SHARED_VERSION;
+        header->page_size = page;
+        header->object_size = object_size;
+        header->capacity = capacity;
+        header->segment_bytes = segment_bytes;
+        header->payload_offset = payload_offset;
+        atomic_store_explicit(&header->ready, 1, memory_order_release);
+        munmap(header, page);
+        rv = map_shared(fd, name);
+        fd = -1;
+    }
+    else if (name && fd >= 0)
+    {
+        shm_unlink(name);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#else
+    UNUSED(name);
+    UNUSED(object_size);
+    UNUSED(capacity);
+#endif
+    if (rv == NULL)
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not create shared pool.");
+    }
+
+    return rv;
+}
+
+op_allocator op_ll_attach_shared(const char *name)
+{
+    op_allocator rv = NULL;
+
+#if OP_CAN_MAP
+    int fd = name ? shm_open(name, O_RDWR, 0) : -1;
+    if (fd >= 0)
+    {
+        rv = map_shared(fd, NULL);
+    }
+#else
+    UNUSED(name);
+#endif
+    if (rv == NULL)
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not attach to shared pool.");
+    }
+
+    return rv;
+}
+
+op_allocator op_ll_clone(const op_allocator allocator)
+{
+    op_allocator rv = NULL;
+
+    if (allocator && allocator->initialized && allocator->config.clonable
+            && (allocator->config.constructor || allocator->config.destructor))
+    {
+        /* both sides would run the destructor on the same constructed state, releasing whatever it owns twice */
+        op_error_handler(__FILE__, __LINE__, "Allocators with constructor or destructor hooks cannot be cloned.");
+    }
+    else if (allocator && allocator->initialized && allocator->config.clonable)
+    {
+        rv = malloc(sizeof(struct _op_allocator));
+    }
+    if (rv)
+    {
+        *rv = *allocator;
+        rv->next_allocator = NULL;
+        rv->trace_id = 0;
+        rv->reserve = NULL;
+        rv->spilled = NULL;
+        rv->spill_count = rv->spill_capacity = 0;
+        rv->scrub_queue = rv->clean_stack = NULL;
+        rv->scrub_flags = NULL;
+        rv->scrub_head = rv->scrub_count = rv->scrub_capacity = 0;
+        rv->free_links = NULL;
+        rv->pool = malloc(allocator->maximum_objects * sizeof(_ab_t));
+        rv->chunks = malloc(allocator->chunk_count * sizeof(_chunk_t));
+        rv->chunk_count = 0;
+
+        bool valid = rv->pool && rv->chunks && resize_slot_state(rv, allocator->maximum_objects);
+        if (valid)
+        {
+            memcpy(rv->pool, allocator->pool, allocator->maximum_objects * sizeof(_ab_t));
+            if (allocator->config.placement == OP_PLACE_LIFO)
+            {
+                memcpy(rv->free_links, allocator->free_links, allocator->maximum_objects * sizeof(_free_link_t));
+            }
+            if (allocator->config.deferred_zeroing)
+            {
+                /* the copy's queue starts at its beginning */
+                for (size_t q = 0; q < allocator->scrub_count; q++)
+                {
+                    rv->scrub_queue[q] = allocator->scrub_queue[(allocator->scrub_head + q) % allocator->scrub_capacity];
+                }
+                rv->scrub_count = allocator->scrub_count;
+                memcpy(rv->clean_stack, allocator->clean_stack, allocator->clean_count * sizeof(size_t));
+                memcpy(rv->scrub_flags, allocator->scrub_flags, allocator->maximum_objects);
+            }
+        }
+        for (size_t c = 0; valid && c < allocator->chunk_count; c++)
+        {
+            _chunk_t *original = &allocator->chunks[c], *copy = &rv->chunks[c];
+            *copy = *original;
+            valid = original->memory == NULL || clone_chunk(original, copy);
+            if (valid)
+            {
+                /* counted in full even though the pages are shared until written */
+                rv->chunk_count++;
+                memory_budget.bytes += copy->memory ? copy->count * rv->stride : 0;
+                for (size_t i = copy->offset; copy->memory && i < copy->offset + copy->count; i++)
+                {
+                    rv->pool[i].data = copy->memory + (allocator->pool[i].data - original->memory);
+                }
+            }
+        }
+        if (valid && allocator->reserve)
+        {
+            valid = (rv->reserve = op_ll_clone(allocator->reserve)) != NULL;
+        }
+        if (valid && allocator->spill_count > 0)
+        {
+            /* on failure the clone's record stays as it was, so deinitialization frees it with what it holds */
+            void **spilled = realloc(rv->spilled, allocator->spill_count * sizeof(void *));
+            valid = spilled != NULL;
+            if (valid)
+            {
+                rv->spilled = spilled;
+                rv->spill_capacity = allocator->spill_count;
+            }
+        }
+        for (size_t s = 0; valid && s < allocator->spill_count; s++)
+        {
+            /* objects past the capacity limits come from malloc() and are simply copied */
+            void *object = object_alignment(rv) ? aligned_alloc(object_alignment(rv), rv->stride) : malloc(rv->stride);
+            valid = object != NULL;
+            if (valid)
+            {
+                memcpy(object, allocator->spilled[s], rv->stride);
+                rv->spilled[rv->spill_count++] = object;
+                memory_budget.bytes += rv->stride;
+            }
+        }
+
+        if (valid)
+        {
+            register_allocator(rv);
+            check_memory_budget();
+        }
+        else
+        {
+            if (rv->pool && rv->chunks)
+            {
+                op_ll_deinitialize_allocator(rv);   /* releases the chunks cloned so far */
+            }
+            else
+            {
+                free(rv->scrub_queue);
+                free(rv->clean_stack);
+                free(rv->scrub_flags);
+                free(rv->free_links);
+                free(rv->chunks);
+                free(rv->pool);
+                free(rv);
+            }
+            rv = NULL;
+        }
+    }
+    if (rv == NULL)
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not clone allocator.");
+    }
+
+    return rv;
+}
+
+void op_ll_set_memory_budget(const size_t high_watermark, const size_t low_watermark,
+                             op_pressure_callback callback, void *context)
+{
+    bool taken = lock_budget();
+    memory_budget.high_watermark = high_watermark;
+    memory_budget.low_watermark = low_watermark < high_watermark ? low_watermark : high_watermark;
+    memory_budget.callback = callback;
+    memory_budget.context = context;
+    memory_budget.above = false;
+    unlock_budget(taken);
+    check_memory_budget();
+}
+
+size_t op_ll_memory_in_use(void)
+{
+    return memory_budget.bytes;
+}
+
+size_t op_ll_trim(void)
+{
+    size_t rv = 0;
+
+    bool taken = lock_budget();
+    if (!memory_budget.checking)
+    {
+        memory_budget.checking = true;
+        rv = trim_allocators();
+        memory_budget.checking = false;
+    }
+    unlock_budget(taken);
+    check_memory_budget();
+
+    return rv;
+}
+
+bool op_ll_poll_memory_pressure(const double psi_threshold)
+{
+    bool taken = lock_budget();
+    bool rv = !memory_budget.checking && read_memory_pressure(psi_threshold);
+    op_pressure_callback callback = memory_budget.callback;
+    void *context = memory_budget.context;
+
+    if (rv)
+    {
+        memory_budget.checking = true;
+        trim_allocators();
+        memory_budget.checking = false;
+    }
+    unlock_budget(taken);
+    if (rv)
+    {
+        notify_pressure(callback, context, OP_PRESSURE_HIGH);
+    }
+
+    return rv;
+}
+
+void op_ll_deinitialize_allocator(op_allocator allocator)
+{
+    if (allocator && allocator->initialized)
+    {
+        allocator->initialized = false;
+        unregister_allocator(allocator);
+        if (allocator->use_chunks)
+        {
+            for (size_t c = 0; c < allocator->chunk_count; c++)
+            {
+                if (allocator->chunks[c].memory != NULL) { release_chunk(allocator, &allocator->chunks[c]); }
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < allocator->maximum_objects; i++)
+            {
+                if (allocator->pool[i].data != NULL) { release_object(allocator, i); }
+            }
+        }
+        while (allocator->spill_count > 0)
+        {
+            release_overflow(allocator, allocator->spilled[allocator->spill_count - 1]);
+        }
+        if (allocator->reserve)
+        {
+            op_ll_deinitialize_allocator(allocator->reserve);
+        }
+#if OP_CAN_MAP
+        if (allocator->persistent_header)
+        {
+            munmap(allocator->persistent_header, allocator->persistent_header->page_size);
+        }
+        if (allocator->persistent)
+        {
+            flock(allocator->persistent_fd, LOCK_UN);
+            close(allocator->persistent_fd);
+        }
+        if (allocator->shared)
+        {
+            munmap(allocator->shared, allocator->shared->segment_bytes);
+            close(allocator->shared_fd);
+        }
+#endif
+        free(allocator->spilled);
+        free(allocator->scrub_queue);
+        free(allocator->clean_stack);
+        free(allocator->scrub_flags);
+        free(allocator->free_links);
+        free(allocator->chunks);
+        free(allocator->pool);
+        free(allocator);
+        check_memory_budget();
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "Attempted to deinitialize an allocator that was not initialized.");
+    }
+}
+
+op_allocator_stats op_ll_get_allocator_stats(const op_allocator allocator)
+{
+    op_allocator_stats rv = { 0 };
+    if (allocator != NULL && allocator->initialized && allocator->shared)
+    {
+        rv.object_size = rv.slot_stride = allocator->object_size;
+        rv.maximum_objects = allocator->shared->capacity;
+        rv.active_objects = atomic_load(&allocator->shared->active);
+        rv.available_objects = rv.maximum_objects - rv.active_objects;
+        rv.reserved_bytes = allocator->shared->segment_bytes;
+
+        /* slots are touched in index order until the first is reused, so everything past them was never faulted in */
+        size_t untouched = atomic_load(&allocator->shared->untouched);
+        rv.resident_bytes = allocator->shared->payload_offset
+                            + (untouched < rv.maximum_objects ? untouched : rv.maximum_objects) * allocator->stride;
+    }
+    else if (allocator != NULL && allocator->initialized)
+    {
+        rv.object_size = allocator->object_size;
+        rv.maximum_objects = allocator->maximum_objects;
+        rv.active_objects = allocator->active_objects;
+        rv.slot_stride = allocator->stride;
+
+        rv.padding_bytes = allocator->backed_objects * (allocator->stride - allocator->object_size);
+        rv.dirty_objects = allocator->dirty_objects;
+        rv.inline_zeroings = allocator->inline_zeroings;
+        rv.available_objects = allocator->backed_objects - allocator->active_objects;
+        rv.available_low_water = allocator->available_low_water;
+        rv.growth_requests = allocator->growth_requests;
+        rv.exhausted_allocations = allocator->exhausted_allocations;
+        rv.growth_pending = allocator->growth_requested;
+        rv.reserve_objects = allocator->reserve ? allocator->reserve->active_objects : 0;
+        rv.spilled_objects = allocator->spill_count;
+        rv.spilled_bytes = allocator->spill_count * allocator->stride;
+        rv.capped_allocations = allocator->capped_allocations;
+        rv.decayed_chunks = allocator->decayed_chunks;
+        rv.reserved_bytes = allocator->backed_objects * allocator->stride;
+        rv.resident_bytes = rv.reserved_bytes - allocator->advised_bytes;
+    }
+    return rv;
+}
+
+size_t op_ll_capacity(const op_allocator allocator)
+{
+    size_t rv = 0;
+    if (allocator != NULL && allocator->initialized)
+    {
+        rv = allocator->shared ? allocator->shared->capacity : allocator->maximum_objects;
+    }
+    return rv;
+}
+
+op_allocator_config op_ll_default_allocator_config(void)
+{
+    op_allocator_config rv =
+    {
+        .placement = OP_PLACE_LOWEST_INDEX,
+        .free_list_sort_interval = 0,
+        .cache_coloring = false,
+        .cache_line_padding = false,
+        .constructor = NULL,
+        .destructor = NULL,
+        .hook_context = NULL,
+        .deferred_zeroing = false,
+        .bounded_latency = false,
+        .low_watermark = 0,
+        .high_watermark = 0,
+        .max_objects = 0,
+        .max_bytes = 0,
+        .overflow = OP_OVERFLOW_FAIL,
+        .reserve_count = 0,
+        .decay_ms = 0,
+        .advise_release = false,
+        .init_threads = 1,
+        .clonable = false,
+        .io_buffers = false,
+        .trim_on_pressure = false,
+    };
+    return rv;
+}
+
+op_allocator op_ll_initialize_allocator(const size_t object_size, const size_t initial_count,
+                                        const op_ll_allocator_mode mode)
+{
+    return op_ll_initialize_configured_allocator(object_size, initial_count, mode, NULL);
+}
+
+op_allocator op_ll_initialize_configured_allocator(const size_t object_size, const size_t initial_count,
+                                                   const op_ll_allocator_mode mode, const op_allocator_config *config)
+{
+    bool use_chunks = false, use_linear = false;
+    switch (mode)
+    {
+    case OP_DOUBLING_INDIVIDUAL:
+        use_chunks = false;
+        use_linear = false;
+        break;
+
+    case OP_DOUBLING_CHUNK:
+        use_chunks = true;
+        use_linear = false;
+        break;
+
+    case OP_LINEAR_INDIVIDUAL:
+        use_chunks = false;
+        use_linear = true;
+        break;
+
+    case OP_LINEAR_CHUNK:
+        use_chunks = true;
+        use_linear = true;
+        break;
+    };
+
+    op_allocator rv = calloc(1, sizeof(struct _op_allocator));
+    if (rv)
+    {
+        /* set the allocator configuration */
+        rv->object_size = object_size;
+        rv->stride = object_size;
+        rv->initial_count = rv->maximum_objects = initial_count;
+        rv->use_chunks = use_chunks;
+        rv->use_linear = use_linear;
+        rv->initialized = true;
+        rv->config = config ? *config : op_ll_default_allocator_config();
+        if (rv->config.io_buffers)
+        {
+            /* pages are a multiple of cache lines, so padding is implied and coloring would break page alignment */
+            rv->stride = (object_size + page_size() - 1) / page_size() * page_size();
+            rv->config.cache_coloring = false;
+        }
+        else if (rv->config.cache_line_padding)
+        {
+            rv->stride = (object_size + OP_CACHE_LINE_SIZE - 1) / OP_CACHE_LINE_SIZE * OP_CACHE_LINE_SIZE;
+        }
+        if (rv->config.constructor)
+        {
+            rv->config.deferred_zeroing = false;    /* constructed objects are never zeroed */
+        }
+        if (!OP_CAN_MAP || !use_chunks)
+        {
+            rv->config.advise_release = false;
+            rv->config.clonable = false;
+        }
+        if (rv->config.clonable)
+        {
+            rv->config.advise_release = false;  /* handing back pages of a file mapping frees nothing */
+        }
+        rv->free_head = rv->free_tail = NO_SLOT;
+        if (rv->maximum_objects > pool_limit(rv))
+        {
+            rv->maximum_objects = pool_limit(rv);   /* the initial objects count against the limits too */
+        }
+
+        /* limits below one object are refused outright, since overflow policies only take over from a pool */
+        if (pool_limit(rv) == 0)
+        {
+            free(rv);
+            rv = NULL;
+            op_error_handler(__FILE__, __LINE__, "Capacity limits leave no room for a single object.");
+        }
+        /* allocate the space for the object pool itself. */
+        else if (rv->maximum_objects > 0 && (rv->pool = calloc(rv->maximum_objects, sizeof(_ab_t)))
+                && resize_slot_state(rv, rv->maximum_objects))
+        {
+            for (size_t i = 0; i < rv->maximum_objects; i++)
+            {
+                push_free_slot(rv, i, false);
+            }
+            if (use_chunks)
+            {
+                if (!fill_chunks(rv, 0, rv->maximum_objects))
+                {
+                    free(rv->scrub_queue);
+                    free(rv->clean_stack);
+                    free(rv->scrub_flags);
+                    free(rv->free_links);
+                    free(rv->chunks);
+                    free(rv->pool);
+                    free(rv);
+                    rv = NULL;
+                }
+            }
+            else if (rv->config.bounded_latency)
+            {
+                /* bounded allocators never back objects on demand, so the initial objects are backed up front */
+                for (size_t i = 0; i < rv->maximum_objects; i++)
+                {
+                    back_slot(rv, i);
+                }
+            }
+            if (rv)
+            {
+                rv->available_low_water = rv->backed_objects;
+            }
+            if (rv && rv->config.overflow == OP_OVERFLOW_RESERVE && rv->config.reserve_count > 0)
+            {
+                /* the reserve is an allocator of its own which is filled now and capped so it never grows */
+                op_allocator_config reserve_config = rv->config;
+                reserve_config.free_list_sort_interval = 0;
+                reserve_config.deferred_zeroing = false;
+                reserve_config.bounded_latency = false;
+                reserve_config.max_objects = rv->config.reserve_count;
+                reserve_config.max_bytes = 0;
+                reserve_config.overflow = OP_OVERFLOW_FAIL;
+                reserve_config.reserve_count = 0;
+                reserve_config.trim_on_pressure = false;
+                if ((rv->reserve = op_ll_initialize_configured_allocator(object_size, rv->config.reserve_count,
+                                   OP_LINEAR_CHUNK, &reserve_config)) == NULL)
+                {
+                    op_ll_deinitialize_allocator(rv);
+                    rv = NULL;
+                }
+                else
+                {
+                    rv->reserve->keep_on_trim = true;
+                }
+            }
+            if (rv)
+            {
+                register_allocator(rv);
+                check_memory_budget();
+            }
+        }
+        else
+        {
+            free(rv->scrub_queue);
+            free(rv->clean_stack);
+            free(rv->scrub_flags);
+            free(rv->free_links);
+            free(rv->pool);
+            free(rv);
+            rv = NULL;
+            op_error_handler(__FILE__, __LINE__, "Could not allocate internal space for allocator.");
+        }
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not allocate space for allocator handle.");
+    }
+
+    return rv;
+}
+
+bool op_ll_trace_start(const char *path)
+{
+    bool rv = false;
+
+#if OP_CAN_TRACE
+    int fd = -1;
+    if (atomic_load(&trace_state.active))
+    {
+        op_error_handler(__FILE__, __LINE__, "A trace is already running.");
+    }
+    else if (path == NULL || (fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not create trace file.");
+    }
+    else
+    {
+        /* discard whatever threads recorded after the last trace stopped */
+        for (_trace_ring_t *ring = atomic_load(&trace_state.rings); ring; ring = ring->next)
+        {
+            while (atomic_flag_test_and_set(&ring->flushing)) { }
+            atomic_store(&ring->tail, atomic_load(&ring->head));
+            atomic_flag_clear(&ring->flushing);
+        }
+        memset(&trace_state.header, 0, sizeof(op_trace_header));
+        memcpy(trace_state.header.magic, TRACE_MAGIC, sizeof(trace_state.header.magic));
+        trace_state.header.version = TRACE_VERSION;
+        trace_state.header.record_size = sizeof(op_trace_record);
+        trace_state.header.start_ns = trace_ns();
+        trace_state.header.start_ticks = trace_ticks();
+        atomic_store(&trace_state.offset, sizeof(op_trace_header));
+        atomic_store(&trace_state.records, 0);
+        atomic_store(&trace_state.dropped, 0);
+        atomic_store(&trace_state.failed, false);
+        atomic_store(&trace_state.fd, fd);
+        rv = pwrite(fd, &trace_state.header, sizeof(op_trace_header), 0) == sizeof(op_trace_header);
+        if (rv)
+        {
+            atomic_store(&trace_state.active, true);
+        }
+        else
+        {
+            atomic_store(&trace_state.fd, -1);
+            close(fd);
+            op_error_handler(__FILE__, __LINE__, "Could not write trace file header.");
+        }
+    }
+#else
+    UNUSED(path);
+    op_error_handler(__FILE__, __LINE__, "Tracing is not compiled in; build with OP_TRACE defined to 1.");
+#endif
+
+    return rv;
+}
+
+void op_ll_trace_flush(void)
+{
+#if OP_CAN_TRACE
+    for (_trace_ring_t *ring = atomic_load(&trace_state.rings); ring; ring = ring->next)
+    {
+        if (!atomic_flag_test_and_set(&ring->flushing))
+        {
+            if (atomic_load(&trace_state.active))
+            {
+                drain_trace_ring(ring);
+            }
+            atomic_flag_clear(&ring->flushing);
+        }
+    }
+#endif
+}
+
+bool op_ll_trace_stop(void)
+{
+    bool rv = false;
+
+#if OP_CAN_TRACE
+    bool expected = true;
+    if (atomic_compare_exchange_strong(&trace_state.active, &expected, false))
+    {
+        /* a thread which takes its ring's flag after this sees the trace inactive and leaves the file alone */
+        for (_trace_ring_t *ring = atomic_load(&trace_state.rings); ring; ring = ring->next)
+        {
+            while (atomic_flag_test_and_set(&ring->flushing)) { }
+            drain_trace_ring(ring);
+            atomic_flag_clear(&ring->flushing);
+        }
+        int fd = atomic_exchange(&trace_state.fd, -1);
+        trace_state.header.stop_ns = trace_ns();
+        trace_state.header.stop_ticks = trace_ticks();
+        trace_state.header.records = atomic_load(&trace_state.records);
+        trace_state.header.dropped = atomic_load(&trace_state.dropped);
+        rv = pwrite(fd, &trace_state.header, sizeof(op_trace_header), 0) == sizeof(op_trace_header)
+             && !atomic_load(&trace_state.failed) && trace_state.header.dropped == 0;
+        rv = close(fd) == 0 && rv;
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "No trace is running.");
+    }
+#endif
+
+    return rv;
+}
+
+/*******************************************************************************
+* Static helper function definitions
+*******************************************************************************/
+
+static bool fill_chunks(op_allocator allocator, const size_t offset, const size_t object_count)
+{
+    bool rv = false;
+
+    _chunk_t *chunks = realloc(allocator->chunks, sizeof(_chunk_t) * (allocator->chunk_count + 1));
+    if (chunks)
+    {
+        allocator->chunks = chunks;
+        _chunk_t *chunk = &chunks[allocator->chunk_count];
+        *chunk = (_chunk_t)
+        {
+            .block = NULL, .memory = NULL, .offset = offset, .count = object_count,
+            .color = allocator->next_color, .lifetime = OP_HINT_NONE,
+        };
+        for (size_t i = 0; i < object_count; i++)
+        {
+            allocator->pool[i + offset].chunk = allocator->chunk_count;
+        }
+        if (populate_chunk(allocator, chunk))
+        {
+            allocator->chunk_count++;
+            allocator->next_color = (allocator->next_color + 1) % OP_CACHE_COLORS;
+            rv = true;
+        }
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not fill chunks when initializing or expanding.");
+    }
+
+    return rv;
+}
+
+static bool populate_chunk(op_allocator allocator, _chunk_t *chunk)
+{
+    bool rv = true;
+
+    /* A colored chunk starts on a boundary of the whole color span and its first slot is then pushed along by the
+     * chunk's color.  Successive chunks therefore put their slots in different cache sets whatever alignment the
+     * chunks were allocated at, as even large power-of-two objects would otherwise all share one.  Padded chunks
+     * start on a cache line. */
+    bool line_aligned = allocator->config.cache_coloring || allocator->config.cache_line_padding;
+    size_t color = allocator->config.cache_coloring ? chunk->color : 0;
+    size_t alignment = allocator->config.cache_coloring ? OP_CACHE_COLORS * OP_CACHE_LINE_SIZE : OP_CACHE_LINE_SIZE;
+    size_t slack = line_aligned ? alignment + color * OP_CACHE_LINE_SIZE - 1 : 0;
+    size_t threads = count_init_threads(allocator, chunk);
+#if OP_CAN_MAP
+    if (allocator->persistent)
+    {
+        map_persistent_chunk(allocator, chunk);
+    }
+    else if (allocator->config.clonable)
+    {
+        /* a file of its own, so that clones can map the same pages copy-on-write */
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        chunk->block_bytes = (chunk->count * allocator->stride + slack + page - 1) / page * page;
+        chunk->fd = create_anonymous_file();
+        chunk->cloned = false;
+        chunk->block = chunk->fd >= 0 && ftruncate(chunk->fd, (off_t) chunk->block_bytes) == 0
+                       ? mmap(NULL, chunk->block_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, chunk->fd, 0) : MAP_FAILED;
+        if (chunk->block == MAP_FAILED)
+        {
+            if (chunk->fd >= 0) { close(chunk->fd); }
+            chunk->block = NULL;
+        }
+    }
+    else if (allocator->config.advise_release || allocator->config.io_buffers)
+    {
+        /* whole pages of their own, so that slots are page-aligned and the pages of an empty chunk can be handed back
+         * without unmapping it */
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        chunk->block_bytes = (chunk->count * allocator->stride + slack + page - 1) / page * page;
+        chunk->block = mmap(NULL, chunk->block_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (chunk->block == MAP_FAILED)
+        {
+            chunk->block = NULL;
+        }
+    }
+    else
+#endif
+    {
+        /* chunks initialized in parallel are zeroed by the threads, which also faults their pages in */
+        chunk->block = allocator->config.io_buffers ? aligned_alloc(page_size(), chunk->count * allocator->stride)
+                       : threads > 1 ? malloc(chunk->count * allocator->stride + slack)
+                       : calloc(1, chunk->count * allocator->stride + slack);
+        if (chunk->block && allocator->config.io_buffers && threads <= 1)
+        {
+            memset(chunk->block, 0, chunk->count * allocator->stride);
+        }
+    }
+    if (chunk->block)
+    {
+        allocator->backed_objects += chunk->count;
+        memory_budget.bytes += chunk->count * allocator->stride;
+        chunk->memory = chunk->states ? chunk->block + ((_persistent_chunk_t *) chunk->block)->payload_offset
+                        : chunk->block;
+        if (allocator->config.decay_ms) { chunk->empty_since = op_time_ms(); }
+        if (line_aligned)
+        {
+            chunk->memory = chunk->block + (alignment - (uintptr_t) chunk->block % alignment) % alignment
+                            + color * OP_CACHE_LINE_SIZE;
+        }
+        prepare_chunk(allocator, chunk, threads);
+        for (size_t i = 0; allocator->config.deferred_zeroing && i < chunk->count; i++)
+        {
+            if (allocator->pool[i + chunk->offset].in_use == NOT_IN_USE)
+            {
+                push_clean_slot(allocator, i + chunk->offset);
+            }
+        }
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not fill chunks when initializing or expanding.");
+        rv = false;
+    }
+
+    return rv;
+}
+
+static size_t count_init_threads(const op_allocator allocator, const _chunk_t *chunk)
+{
+    size_t rv = 1;
+
+#if OP_CAN_THREAD
+    size_t slices = chunk->count * allocator->stride / OP_PARALLEL_INIT_SLICE;
+    if (allocator->config.init_threads > 1 && slices > 1 && !allocator->persistent)
+    {
+        rv = slices < allocator->config.init_threads ? slices : allocator->config.init_threads;
+    }
+#else
+    UNUSED(allocator);
+    UNUSED(chunk);
+#endif
+
+    return rv;
+}
+
+static void prepare_chunk(op_allocator allocator, _chunk_t *chunk, const size_t threads)
+{
+    bool prepared = false;
+
+#if OP_CAN_THREAD
+    _slice_t *slices = threads > 1 ? malloc(threads * sizeof(_slice_t)) : NULL;
+    pthread_t *workers = slices ? malloc(threads * sizeof(pthread_t)) : NULL;
+    if (workers)
+    {
+        for (size_t t = 0; t < threads; t++)
+        {
+            slices[t] = (_slice_t)
+            {
+                .allocator = allocator, .chunk = chunk, .zero = true,
+                .first = chunk->count * t / threads, .last = chunk->count * (t + 1) / threads,
+            };
+        }
+
+        /* the calling thread takes the first slice, and any slice whose thread cannot be started as well */
+        size_t spawned = 0;
+        for (size_t t = 1; t < threads; t++)
+        {
+            if (pthread_create(&workers[spawned], NULL, prepare_slots, &slices[t]) == 0)
+            {
+                spawned++;
+            }
+            else
+            {
+                prepare_slots(&slices[t]);
+            }
+        }
+        prepare_slots(&slices[0]);
+        for (size_t t = 0; t < spawned; t++)
+        {
+            pthread_join(workers[t], NULL);
+        }
+        prepared = true;
+    }
+    free(workers);
+    free(slices);
+#endif
+
+    if (!prepared)
+    {
+        /* only chunks meant for parallel initialization come from malloc() rather than calloc() */
+        _slice_t whole = { .allocator = allocator, .chunk = chunk, .last = chunk->count, .zero = threads > 1 };
+        prepare_slots(&whole);
+    }
+}
+
+static void *prepare_slots(void *slice)
+{
+    const _slice_t *s = slice;
+    op_allocator allocator = s->allocator;
+
+    if (s->zero)
+    {
+        memset(&s->chunk->memory[s->first * allocator->stride], 0, (s->last - s->first) * allocator->stride);
+    }
+    for (size_t i = s->first; i < s->last; i++)
+    {
+        allocator->pool[i + s->chunk->offset].data = &s->chunk->memory[i * allocator->stride];
+        if (allocator->config.constructor)
+        {
+            allocator->config.constructor(allocator->config.hook_context, allocator->pool[i + s->chunk->offset].data);
+        }
+    }
+
+    return NULL;
+}
+
+static bool map_persistent_chunk(op_allocator allocator, _chunk_t *chunk)
+{
+    bool rv = false;
+
+#if OP_CAN_MAP
+    size_t page = allocator->persistent_header->page_size;
+    _persistent_chunk_t record =
+    {
+        .offset = chunk->offset, .count = chunk->count,
+        .payload_offset = (sizeof(_persistent_chunk_t) + chunk->count + page - 1) / page * page,
+    };
+    record.region_bytes = record.payload_offset + (chunk->count * allocator->stride + page - 1) / page * page;
+
+    /* cutting the file back first drops whatever an uncommitted region left behind, so the new region reads as zero */
+    off_t at = (off_t) allocator->persistent_end;
+    void *block = ftruncate(allocator->persistent_fd, at) == 0
+                  && ftruncate(allocator->persistent_fd, at + (off_t) record.region_bytes) == 0
+                  ? mmap(NULL, record.region_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, allocator->persistent_fd, at)
+                  : MAP_FAILED;
+    if (block != MAP_FAILED)
+    {
+        memcpy(block, &record, sizeof(record));
+        if (msync(block, record.payload_offset, MS_SYNC) == 0)
+        {
+            chunk->block = block;
+            chunk->block_bytes = record.region_bytes;
+            chunk->states = chunk->block + sizeof(_persistent_chunk_t);
+            allocator->persistent_end += record.region_bytes;
+
+            /* the commit point: the region now belongs to the pool */
+            allocator->persistent_header->chunk_count = (size_t) (chunk - allocator->chunks) + 1;
+            msync(allocator->persistent_header, page, MS_SYNC);
+            rv = true;
+        }
+        else
+        {
+            munmap(block, record.region_bytes);
+        }
+    }
+#else
+    UNUSED(allocator);
+    UNUSED(chunk);
+#endif
+
+    return rv;
+}
+
+/* A pool which failed to open before anything was committed leaves no trace: a file it created is removed and an
+ * empty file it was given is emptied again, so that the next open starts afresh. */
+static void abandon_persistent_file(const char *path, const int fd, const bool created)
+{
+    if (created)
+    {
+        unlink(path);
+    }
+    else if (ftruncate(fd, 0) != 0)
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not empty persistent pool file.");
+    }
+}
+
+static bool load_persistent_chunks(op_allocator allocator)
+{
+    bool rv = true;
+
+#if OP_CAN_MAP
+    size_t page = allocator->persistent_header->page_size;
+    struct stat file;
+    rv = fstat(allocator->persistent_fd, &file) == 0;
+    for (size_t c = 0; rv && c < allocator->persistent_header->chunk_count; c++)
+    {
+        /* a region reaching past the end of a truncated file would raise SIGBUS on first touch instead of failing
+         * here, and the sums below are checked in a form which cannot overflow */
+        _persistent_chunk_t record;
+        rv = pread(allocator->persistent_fd, &record, sizeof(record), (off_t) allocator->persistent_end)
+             == (ssize_t) sizeof(record)
+             && record.offset == allocator->maximum_objects && record.count > 0 && record.region_bytes % page == 0
+             && record.region_bytes <= (uint64_t) file.st_size
+             && allocator->persistent_end <= (uint64_t) file.st_size - record.region_bytes
+             && record.payload_offset <= record.region_bytes
+             && record.count <= (record.region_bytes - record.payload_offset) / allocator->stride
+             && record.payload_offset >= sizeof(_persistent_chunk_t)
+             && record.count <= record.payload_offset - sizeof(_persistent_chunk_t);
+
+        _ab_t *pool = rv ? realloc(allocator->pool, (record.offset + record.count) * sizeof(_ab_t)) : NULL;
+        _chunk_t *chunks = pool ? realloc(allocator->chunks, (c + 1) * sizeof(_chunk_t)) : NULL;
+        if (pool) { allocator->pool = pool; }
+        if (chunks) { allocator->chunks = chunks; }
+        uint8_t *block = chunks ? mmap(NULL, record.region_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                       allocator->persistent_fd, (off_t) allocator->persistent_end) : MAP_FAILED;
+        rv = block != MAP_FAILED;
+        if (rv)
+        {
+            _chunk_t *chunk = &allocator->chunks[allocator->chunk_count++];
+            *chunk = (_chunk_t)
+            {
+                .block = block, .memory = block + record.payload_offset, .offset = record.offset, .count = record.count,
+                .block_bytes = record.region_bytes, .states = block + sizeof(_persistent_chunk_t),
+                .lifetime = OP_HINT_NONE,
+            };
+            allocator->maximum_objects += chunk->count;
+            allocator->backed_objects += chunk->count;
+            memory_budget.bytes += chunk->count * allocator->stride;
+            allocator->persistent_end += record.region_bytes;
+
+            for (size_t i = chunk->offset; i < chunk->offset + chunk->count; i++)
+            {
+                uint8_t state = chunk->states[i - chunk->offset];
+                allocator->pool[i] = (_ab_t)
+                {
+                    .data = &chunk->memory[(i - chunk->offset) * allocator->stride], .chunk = c, .in_use = NOT_IN_USE,
+                };
+                if (state > SNAPSHOT_PINNED)
+                {
+                    rv = false;
+                    push_free_slot(allocator, i, false);
+                }
+                else if (state == SNAPSHOT_FREE)
+                {
+                    push_free_slot(allocator, i, false);
+                }
+                else
+                {
+                    occupy_slot(allocator, i);
+                    if (state == SNAPSHOT_PINNED)
+                    {
+                        allocator->pool[i].pinned = true;
+                        chunk->pinned++;
+                        chunk->states[i - chunk->offset] = SNAPSHOT_PINNED;
+                    }
+                }
+            }
+        }
+    }
+#else
+    UNUSED(allocator);
+#endif
+
+    return rv;
+}
+
+static op_allocator map_shared(int fd, const char *name)
+{
+    op_allocator rv = NULL;
+
+#if OP_CAN_MAP
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    struct stat status;
+    _shared_header_t *header = fstat(fd, &status) == 0 && (size_t) status.st_size >= page
+                               ? mmap(NULL, page, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    size_t segment_bytes = 0;
+    if (header != MAP_FAILED)
+    {
+        /* nothing else in the header is read until the creator has published it.  The links and states must fit
+         * before the payload and the payload within the segment, or another process's damaged header would have
+         * this one touch memory past the end of the mapping. */
+        if (atomic_load_explicit(&header->ready, memory_order_acquire) == 1
+                && memcmp(header->magic, SHARED_MAGIC, sizeof(header->magic)) == 0 && header->version == SHARED_VERSION
+                && header->page_size == page && header->segment_bytes == (size_t) status.st_size
+                && header->object_size > 0 && header->capacity > 0 && header->capacity < UINT32_MAX
+                && header->payload_offset % page == 0 && header->payload_offset <= header->segment_bytes
+                && header->payload_offset >= sizeof(_shared_header_t)
+                && header->capacity <= (header->payload_offset - sizeof(_shared_header_t)) / (sizeof(uint32_t) + 1)
+                && header->object_size <= (header->segment_bytes - header->payload_offset) / header->capacity)
+        {
+            segment_bytes = header->segment_bytes;
+        }
+        munmap(header, page);
+    }
+
+    uint8_t *segment = segment_bytes ? mmap(NULL, segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                       : MAP_FAILED;
+    if (segment != MAP_FAILED && (rv = calloc(1, sizeof(struct _op_allocator))))
+    {
+        rv->shared = (_shared_header_t *) segment;
+        rv->shared_links = (_Atomic uint32_t *) (rv->shared + 1);
+        rv->shared_states = (_Atomic uint8_t *) (rv->shared_links + rv->shared->capacity);
+        rv->shared_slots = segment + rv->shared->payload_offset;
+        rv->shared_fd = fd;
+        rv->object_size = rv->stride = rv->shared->object_size;
+        rv->initialized = true;
+        rv->config = op_ll_default_allocator_config();
+        rv->free_head = rv->free_tail = NO_SLOT;
+    }
+    else
+    {
+        if (segment != MAP_FAILED)
+        {
+            munmap(segment, segment_bytes);
+        }
+        if (name)
+        {
+            shm_unlink(name);
+        }
+        close(fd);
+    }
+#else
+    UNUSED(fd);
+    UNUSED(name);
+#endif
+
+    return rv;
+}
+
+static int create_anonymous_file(void)
+{
+    int rv = -1;
+
+#if OP_CAN_MAP && defined(__linux__)
+    rv = memfd_create("opalloc", MFD_CLOEXEC);
+#elif OP_CAN_MAP
+    /* without memfd an anonymous file is a shared memory object that nobody else can find */
+    char name[64];
+    snprintf(name, sizeof(name), "/opalloc.%ld.%p", (long) getpid(), (void *) &name);
+    rv = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (rv >= 0) { shm_unlink(name); }
+#endif
+
+    return rv;
+}
+
+static bool clone_chunk(_chunk_t *original, _chunk_t *copy)
+{
+    bool rv = false;
+
+#if OP_CAN_MAP
+    /* A chunk not cloned before still has all its contents in its file.  Otherwise its written pages are private to
+     * it, so its contents go to a new file first; that is the one case in which cloning copies memory. */
+    int source = original->cloned ? create_anonymous_file() : original->fd;
+    bool filled = source >= 0 && (!original->cloned
+                                  || (ftruncate(source, (off_t) original->block_bytes) == 0
+                                      && write_fully(source, original->block, original->block_bytes)));
+    copy->fd = filled ? dup(source) : -1;
+    copy->block = copy->fd >= 0 ? mmap(NULL, copy->block_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, copy->fd, 0)
+                  : MAP_FAILED;
+
+    /* the original is mapped over in place, so its objects keep their addresses */
+    if (copy->block != MAP_FAILED
+            && mmap(original->block, original->block_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, source, 0)
+            != MAP_FAILED)
+    {
+        if (source != original->fd)
+        {
+            close(original->fd);
+            original->fd = source;
+        }
+        original->cloned = copy->cloned = true;
+        copy->memory = copy->block + (original->memory - original->block);
+        rv = true;
+    }
+    else
+    {
+        if (copy->block != MAP_FAILED) { munmap(copy->block, copy->block_bytes); }
+        if (copy->fd >= 0)             { close(copy->fd); }
+        if (source != original->fd)    { close(source); }
+    }
+#else
+    UNUSED(original);
+    UNUSED(copy);
+#endif
+
+    return rv;
+}
+
+static void *allocate_shared(op_allocator allocator)
+{
+    void *rv = NULL;
+
+    _shared_header_t *header = allocator->shared;
+    size_t i = NO_SLOT;
+    uint64_t top = atomic_load(&header->free_top);
+    while (i == NO_SLOT && (uint32_t) top != 0)
+    {
+        uint64_t next = ((top >> 32) + 1) << 32 | atomic_load_explicit(&allocator->shared_links[(uint32_t) top - 1],
+                        memory_order_relaxed);
+        if (atomic_compare_exchange_weak(&header->free_top, &top, next))
+        {
+            i = (uint32_t) top - 1;
+        }
+    }
+    if (i == NO_SLOT && atomic_load(&header->untouched) < header->capacity)
+    {
+        /* other processes may get here at the same time, so the count can overshoot the capacity */
+        size_t untouched = atomic_fetch_add(&header->untouched, 1);
+        i = untouched < header->capacity ? untouched : NO_SLOT;
+    }
+
+    if (i != NO_SLOT)
+    {
+        rv = allocator->shared_slots + i * allocator->stride;
+        memset(rv, 0, allocator->object_size);
+        atomic_store(&allocator->shared_states[i], IN_USE);
+        atomic_fetch_add(&header->active, 1);
+        TRACE(allocator, OP_TRACE_ALLOCATE, i);
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "Shared pool is full.");
+    }
+
+    return rv;
+}
+
+static void deallocate_shared(op_allocator allocator, const void *object)
+{
+    _shared_header_t *header = allocator->shared;
+    size_t i = find_shared_slot(allocator, object);
+    uint8_t expected = IN_USE;
+    if (i != OP_NO_HANDLE && atomic_compare_exchange_strong(&allocator->shared_states[i], &expected, NOT_IN_USE))
+    {
+        atomic_fetch_sub(&header->active, 1);
+        uint64_t top = atomic_load(&header->free_top), next;
+        do
+        {
+            atomic_store_explicit(&allocator->shared_links[i], (uint32_t) top, memory_order_relaxed);
+            next = ((top >> 32) + 1) << 32 | (i + 1);
+        }
+        while (!atomic_compare_exchange_weak(&header->free_top, &top, next));
+        TRACE(allocator, OP_TRACE_DEALLOCATE, i);
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "Object is not allocated from this shared pool.");
+    }
+}
+
+static size_t find_shared_slot(const op_allocator allocator, const void *object)
+{
+    const uint8_t *target = object;
+    size_t offset = (size_t) (target - allocator->shared_slots);
+    size_t i = offset / allocator->stride;
+
+    /* the unsigned offset of an object below the slots is huge, so one comparison covers both ends */
+    return target >= allocator->shared_slots && offset % allocator->stride == 0 && i < allocator->shared->capacity
+           && atomic_load(&allocator->shared_states[i]) == IN_USE ? i : OP_NO_HANDLE;
+}
+
+static bool write_fully(int fd, const void *buffer, size_t size)
+{
+#if OP_CAN_MAP
+    const uint8_t *bytes = buffer;
+    while (size > 0)
+    {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0)
+        {
+            return false;
+        }
+        bytes += written;
+        size -= (size_t) written;
+    }
+    return true;
+#else
+    UNUSED(fd);
+    UNUSED(buffer);
+    return size == 0;
+#endif
+}
+
+static bool write_zeroes(int fd, size_t size)
+{
+    static const uint8_t zeroes[4096] = { 0 };
+    bool rv = true;
+    while (rv && size > 0)
+    {
+        size_t n = size < sizeof(zeroes) ? size : sizeof(zeroes);
+        rv = write_fully(fd, zeroes, n);
+        size -= n;
+    }
+    return rv;
+}
+
+static bool read_fully(int fd, void *buffer, size_t size)
+{
+#if OP_CAN_MAP
+    uint8_t *bytes = buffer;
+    while (size > 0)
+    {
+        ssize_t got = read(fd, bytes, size);
+        if (got <= 0)
+        {
+            return false;
+        }
+        bytes += got;
+        size -= (size_t) got;
+    }
+    return true;
+#else
+    UNUSED(fd);
+    UNUSED(buffer);
+    return size == 0;
+#endif
+}
+
+static bool retire_chunk(op_allocator allocator, _chunk_t *chunk)
+{
+    bool rv = true;
+
+    if (allocator->persistent)
+    {
+        rv = false;     /* regions of the file are never given back */
+    }
+    else if (allocator->config.advise_release)
+    {
+        advise_chunk(allocator, chunk);
+    }
+    else if (allocator->config.io_buffers)
+    {
+        rv = false;     /* buffer chunks stay put, as they may be registered with the kernel */
+    }
+    else
+    {
+        release_chunk(allocator, chunk);
+    }
+
+    return rv;
+}
+
+static void advise_chunk(op_allocator allocator, _chunk_t *chunk)
+{
+#if OP_CAN_MAP
+    /* Handed-back pages may come back zeroed, so constructed state is torn down now and rebuilt on reuse.  Zeroed
+     * objects stay zeroed either way. */
+    for (size_t i = 0; allocator->config.destructor && i < chunk->count; i++)
+    {
+        allocator->config.destructor(allocator->config.hook_context, allocator->pool[i + chunk->offset].data);
+    }
+
+    /* only the pages lying wholly inside the chunk's slots are handed back */
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t) chunk->memory + page - 1) & ~(uintptr_t) (page - 1);
+    uintptr_t last = ((uintptr_t) chunk->memory + chunk->count * allocator->stride) & ~(uintptr_t) (page - 1);
+    if (last > first && madvise((void *) first, last - first, OP_MADV_RELEASE) == 0)
+    {
+        chunk->advised_bytes = last - first;
+        allocator->advised_bytes += chunk->advised_bytes;
+        memory_budget.bytes -= chunk->advised_bytes;
+    }
+    chunk->advised = true;
+#else
+    UNUSED(allocator);
+    UNUSED(chunk);
+#endif
+}
+
+static void wake_chunk(op_allocator allocator, _chunk_t *chunk)
+{
+    allocator->advised_bytes -= chunk->advised_bytes;
+    memory_budget.bytes += chunk->advised_bytes;
+    chunk->advised_bytes = 0;
+    chunk->advised = false;
+    for (size_t i = 0; allocator->config.constructor && i < chunk->count; i++)
+    {
+        allocator->config.constructor(allocator->config.hook_context, allocator->pool[i + chunk->offset].data);
+    }
+}
+
+static size_t page_size(void)
+{
+#if OP_CAN_MAP
+    return (size_t) sysconf(_SC_PAGESIZE);
+#else
+    return 4096;
+#endif
+}
+
+static size_t object_alignment(const op_allocator allocator)
+{
+    return allocator->config.io_buffers ? page_size()
+           : allocator->config.cache_line_padding ? OP_CACHE_LINE_SIZE : 0;
+}
+
+static void release_object(op_allocator allocator, const size_t index)
+{
+    if (allocator->config.destructor)
+    {
+        allocator->config.destructor(allocator->config.hook_context, allocator->pool[index].data);
+    }
+    mark_clean(allocator, index);
+    free(allocator->pool[index].data);
+    allocator->pool[index].data = NULL;
+    allocator->backed_objects--;
+    memory_budget.bytes -= allocator->stride;
+}
+
+static void swap_objects(uint8_t *a, uint8_t *b, size_t size)
+{
+    uint8_t buffer[256];
+    for (size_t done = 0; done < size; done += sizeof(buffer))
+    {
+        size_t length = size - done < sizeof(buffer) ? size - done : sizeof(buffer);
+        memcpy(buffer, a + done, length);
+        memcpy(a + done, b + done, length);
+        memcpy(b + done, buffer, length);
+    }
+}
+
+static void release_chunk(op_allocator allocator, _chunk_t *chunk)
+{
+    /* the objects of an advised chunk were destroyed when it was advised */
+    bool destroy = allocator->config.destructor && !chunk->advised;
+    allocator->advised_bytes -= chunk->advised_bytes;
+    memory_budget.bytes += chunk->advised_bytes;
+    chunk->advised_bytes = 0;
+    chunk->advised = false;
+
+    for (size_t i = 0; i < chunk->count; i++)
+    {
+        if (destroy)
+        {
+            allocator->config.destructor(allocator->config.hook_context, allocator->pool[i + chunk->offset].data);
+        }
+        mark_clean(allocator, i + chunk->offset);
+        allocator->pool[i + chunk->offset].data = NULL;
+        if (allocator->config.placement == OP_PLACE_LIFO)
+        {
+            /* unbacked slots go to the back so backed ones are always reused first */
+            unlink_free_slot(allocator, i + chunk->offset);
+            push_free_slot(allocator, i + chunk->offset, false);
+        }
+    }
+#if OP_CAN_MAP
+    if (chunk->block_bytes)
+    {
+        munmap(chunk->block, chunk->block_bytes);
+        if (allocator->config.clonable) { close(chunk->fd); }
+    }
+    else
+#endif
+    {
+        free(chunk->block);
+    }
+    chunk->block = chunk->memory = chunk->states = NULL;
+    chunk->block_bytes = 0;
+    allocator->backed_objects -= chunk->count;
+    memory_budget.bytes -= chunk->count * allocator->stride;
+}
+
+static bool grow_pool(op_allocator allocator)
+{
+    bool rv = false;
+
+    size_t old_size = allocator->maximum_objects;
+    size_t new_size, grow_size;
+    if (allocator->use_linear)
+    {
+        grow_size = allocator->initial_count;
+        new_size = old_size + grow_size;
+    }
+    else
+    {
+        grow_size = old_size;
+        new_size = old_size * 2;
+    }
+    if (new_size > pool_limit(allocator))
+    {
+        new_size = pool_limit(allocator);
+        grow_size = new_size > old_size ? new_size - old_size : 0;
+    }
+    if (grow_size == 0)
+    {
+        return false;   /* at the capacity limits; the caller decides what happens next */
+    }
+
+    _ab_t *pool = realloc(allocator->pool, sizeof(_ab_t) * new_size);
+    if (pool)
+    {
+        allocator->pool = pool;
+        /* we use the for loop here because valgrind is too stupid to figure out memset */
+        for (size_t i = old_size; i < new_size; i++)
+        {
+            allocator->pool[i] = (_ab_t) { .data = NULL, .chunk = 0, .in_use = NOT_IN_USE, .pinned = false };
+        }
+        if (!resize_slot_state(allocator, new_size))
+        {
+            rv = false;
+        }
+        else if (allocator->use_chunks)
+        {
+            rv = fill_chunks(allocator, old_size, grow_size);
+        }
+        else
+        {
+            rv = true;
+        }
+        if (rv)
+        {
+            allocator->maximum_objects = new_size;
+            for (size_t i = old_size; i < new_size; i++)
+            {
+                push_free_slot(allocator, i, false);
+            }
+            TRACE(allocator, OP_TRACE_GROW, new_size);
+        }
+    }
+    else
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not realloc while growing pool.");
+    }
+
+    return rv;
+}
+
+static size_t pool_limit(const op_allocator allocator)
+{
+    size_t rv = allocator->config.max_objects ? allocator->config.max_objects : SIZE_MAX;
+    if (allocator->config.max_bytes && allocator->config.max_bytes / allocator->stride < rv)
+    {
+        rv = allocator->config.max_bytes / allocator->stride;
+    }
+    return rv;
+}
+
+static void *allocate_overflow(op_allocator allocator)
+{
+    void *rv = NULL;
+
+    switch (allocator->config.overflow)
+    {
+    case OP_OVERFLOW_FAIL:
+        op_error_handler(__FILE__, __LINE__, "Allocator reached its capacity limit.");
+        break;
+
+    case OP_OVERFLOW_RESERVE:
+        if (allocator->reserve)
+        {
+            rv = op_ll_allocate_object(allocator->reserve);
+        }
+        else
+        {
+            op_error_handler(__FILE__, __LINE__, "Allocator reached its capacity limit without a reserve.");
+        }
+        break;
+
+    case OP_OVERFLOW_MALLOC:
+        if (allocator->spill_count == allocator->spill_capacity)
+        {
+            size_t capacity = allocator->spill_capacity ? allocator->spill_capacity * 2 : 8;
+            void **spilled = realloc(allocator->spilled, capacity * sizeof(void *));
+            if (spilled == NULL)
+            {
+                op_error_handler(__FILE__, __LINE__, "Could not grow the record of spilled objects.");
+                break;
+            }
+            allocator->spilled = spilled;
+            allocator->spill_capacity = capacity;
+        }
+        if ((rv = object_alignment(allocator) ? aligned_alloc(object_alignment(allocator), allocator->stride)
+                  : malloc(allocator->object_size)) == NULL)
+        {
+            op_error_handler(__FILE__, __LINE__, "Could not spill object to the system allocator.");
+            break;
+        }
+        if (allocator->config.constructor)
+        {
+            allocator->config.constructor(allocator->config.hook_context, rv);
+        }
+        else
+        {
+            memset(rv, 0, allocator->object_size);
+        }
+        allocator->spilled[allocator->spill_count++] = rv;
+        memory_budget.bytes += allocator->stride;
+        break;
+    }
+
+    return rv;
+}
+
+static bool release_overflow(op_allocator allocator, const void *object)
+{
+    if (allocator->reserve && find_slot(allocator->reserve, object) != NO_SLOT)
+    {
+        op_ll_deallocate_object(allocator->reserve, object);
+        return true;
+    }
+
+    for (size_t s = allocator->spill_count; s > 0; s--)
+    {
+        if (allocator->spilled[s - 1] == object)
+        {
+            if (allocator->config.destructor)
+            {
+                allocator->config.destructor(allocator->config.hook_context, allocator->spilled[s - 1]);
+            }
+            free(allocator->spilled[s - 1]);
+            allocator->spilled[s - 1] = allocator->spilled[--allocator->spill_count];
+            memory_budget.bytes -= allocator->stride;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool claim_slot(op_allocator allocator, const size_t index)
+{
+    _ab_t *slot = &allocator->pool[index];
+
+    if (allocator->use_chunks && allocator->chunks[slot->chunk].advised)
+    {
+        wake_chunk(allocator, &allocator->chunks[slot->chunk]);
+    }
+
+    /* constructed objects keep their state from one use to the next, and with deferred zeroing only objects which
+     * have not been scrubbed yet need zeroing here; freshly backed memory is always zeroed already */
+    bool dirty = is_dirty(allocator, index);
+    bool zero = !allocator->config.constructor && (!allocator->config.deferred_zeroing || dirty) && slot->data != NULL;
+
+    if (slot->data != NULL || back_slot(allocator, index))
+    {
+        if (zero)
+        {
+            memset(slot->data, 0, allocator->object_size);
+            if (dirty) { allocator->inline_zeroings++; }
+        }
+        occupy_slot(allocator, index);
+    }
+
+    return slot->data != NULL;
+}
+
+static bool back_slot(op_allocator allocator, const size_t index)
+{
+    _ab_t *slot = &allocator->pool[index];
+
+    if (allocator->use_chunks)
+    {
+        /* the chunk was released by compaction; bring it back */
+        populate_chunk(allocator, &allocator->chunks[slot->chunk]);
+    }
+    else if ((slot->data = object_alignment(allocator) ? aligned_alloc(object_alignment(allocator), allocator->stride)
+                           : calloc(1, allocator->object_size)) == NULL)
+    {
+        op_error_handler(__FILE__, __LINE__, "Could not allocate desired object.");
+    }
+    else
+    {
+        allocator->backed_objects++;
+        memory_budget.bytes += allocator->stride;
+        if (allocator->config.constructor)
+        {
+            allocator->config.constructor(allocator->config.hook_context, slot->data);
+        }
+        else if (object_alignment(allocator))
+        {
+            memset(slot->data, 0, allocator->object_size);
+        }
+    }
+
+    return slot->data != NULL;
+}
+
+static void occupy_slot(op_allocator allocator, const size_t index)
+{
+    _ab_t *slot = &allocator->pool[index];
+
+    mark_clean(allocator, index);
+    unlink_free_slot(allocator, index);
+    slot->in_use = IN_USE;
+    allocator->active_objects++;
+    if (allocator->use_chunks)
+    {
+        _chunk_t *chunk = &allocator->chunks[slot->chunk];
+        chunk->active++;
+        if (chunk->states)
+        {
+            /* the object must be zeroed in the pool file before it is recorded as in use there */
+            atomic_thread_fence(memory_order_release);
+            chunk->states[index - chunk->offset] = SNAPSHOT_IN_USE;
+        }
+    }
+}
+
+static void vacate_slot(op_allocator allocator, const size_t index)
+{
+    _ab_t *slot = &allocator->pool[index];
+
+    if (allocator->use_chunks)
+    {
+        _chunk_t *chunk = &allocator->chunks[slot->chunk];
+        chunk->active--;
+        if (slot->pinned)        { chunk->pinned--; }
+        if (chunk->active == 0)
+        {
+            chunk->lifetime = OP_HINT_NONE;
+            if (allocator->config.decay_ms) { chunk->empty_since = op_time_ms(); }
+        }
+        if (chunk->states) { chunk->states[index - chunk->offset] = SNAPSHOT_FREE; }
+    }
+    slot->in_use = NOT_IN_USE;
+    slot->pinned = false;
+    allocator->active_objects--;
+    push_free_slot(allocator, index, true);
+
+    if (allocator->config.deferred_zeroing)
+    {
+        allocator->scrub_flags[index] |= SCRUB_DIRTY;
+        allocator->dirty_objects++;
+        if (!(allocator->scrub_flags[index] & SCRUB_QUEUED))
+        {
+            allocator->scrub_flags[index] |= SCRUB_QUEUED;
+            allocator->scrub_queue[(allocator->scrub_head + allocator->scrub_count++) % allocator->scrub_capacity] = index;
+        }
+    }
+}
+
+static size_t find_slot(const op_allocator allocator, const void *object)
+{
+    const uint8_t *target = object;
+
+    if (allocator->use_chunks)
+    {
+        for (size_t c = 0; c < allocator->chunk_count; c++)
+        {
+            const _chunk_t *chunk = &allocator->chunks[c];
+            if (chunk->memory != NULL && target >= chunk->memory
+                    && target < chunk->memory + chunk->count * allocator->stride)
+            {
+                size_t distance = target - chunk->memory;
+                return distance % allocator->stride == 0
+                       ? chunk->offset + distance / allocator->stride
+                       : NO_SLOT;
+            }
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < allocator->maximum_objects; i++)
+        {
+            if (allocator->pool[i].data == target)
+            {
+                return i;
+            }
+        }
+    }
+
+    return NO_SLOT;
+}
+
+static size_t find_free_slot(const op_allocator allocator)
+{
+    size_t rv = NO_SLOT;
+
+    switch (allocator->config.placement)
+    {
+    case OP_PLACE_LOWEST_INDEX:
+        break;
+
+    case OP_PLACE_MOST_FULL:
+        if (allocator->use_chunks)
+        {
+            const _chunk_t *best = NULL;
+            for (size_t c = 0; c < allocator->chunk_count; c++)
+            {
+                const _chunk_t *chunk = &allocator->chunks[c];
+                if (chunk->memory != NULL && chunk->active < chunk->count && (best == NULL || chunk->active > best->active))
+                {
+                    best = chunk;
+                }
+            }
+            rv = best ? find_free_slot_in_chunk(allocator, best) : NO_SLOT;
+        }
+        break;
+
+    case OP_PLACE_LIFO:
+        rv = allocator->free_head;
+        break;
+
+    case OP_PLACE_ADDRESS_ORDERED:
+        if (allocator->use_chunks)
+        {
+            const _chunk_t *best = NULL;
+            for (size_t c = 0; c < allocator->chunk_count; c++)
+            {
+                const _chunk_t *chunk = &allocator->chunks[c];
+                if (chunk->memory != NULL && chunk->active < chunk->count && (best == NULL || chunk->memory < best->memory))
+                {
+                    best = chunk;
+                }
+            }
+            rv = best ? find_free_slot_in_chunk(allocator, best) : NO_SLOT;
+        }
+        else
+        {
+            for (size_t i = 0; i < allocator->maximum_objects; i++)
+            {
+                const _ab_t *slot = &allocator->pool[i];
+                if (slot->in_use == NOT_IN_USE && slot->data != NULL
+                        && (rv == NO_SLOT || slot->data < allocator->pool[rv].data))
+                {
+                    rv = i;
+                }
+            }
+        }
+        break;
+    }
+
+    /* Fall back to the lowest index, preferring slots which are still backed by memory over those that would need to
+     * be backed again. */
+    if (rv == NO_SLOT)
+    {
+        rv = find_backed_free_slot(allocator);
+    }
+    for (size_t i = 0; rv == NO_SLOT && i < allocator->maximum_objects; i++)
+    {
+        if (allocator->pool[i].in_use == NOT_IN_USE) { rv = i; }
+    }
+
+    return rv;
+}
+
+static size_t find_free_slot_in_chunk(const op_allocator allocator, const _chunk_t *chunk)
+{
+    for (size_t i = chunk->offset; i < chunk->offset + chunk->count; i++)
+    {
+        if (allocator->pool[i].in_use == NOT_IN_USE) { return i; }
+    }
+    return NO_SLOT;
+}
+
+static size_t find_backed_free_slot(const op_allocator allocator)
+{
+    for (size_t i = 0; i < allocator->maximum_objects; i++)
+    {
+        if (allocator->pool[i].in_use == NOT_IN_USE && allocator->pool[i].data != NULL) { return i; }
+    }
+    return NO_SLOT;
+}
+
+static void push_free_slot(op_allocator allocator, const size_t index, const bool recent)
+{
+    if (allocator->config.placement == OP_PLACE_LIFO)
+    {
+        _free_link_t *links = allocator->free_links;
+        if (recent)
+        {
+            links[index].prev = NO_SLOT;
+            links[index].next = allocator->free_head;
+            if (allocator->free_head != NO_SLOT) { links[allocator->free_head].prev = index; }
+            else                                 { allocator->free_tail = index; }
+            allocator->free_head = index;
+        }
+        else
+        {
+            links[index].next = NO_SLOT;
+            links[index].prev = allocator->free_tail;
+            if (allocator->free_tail != NO_SLOT) { links[allocator->free_tail].next = index; }
+            else                                 { allocator->free_head = index; }
+            allocator->free_tail = index;
+        }
+    }
+}
+
+static void unlink_free_slot(op_allocator allocator, const size_t index)
+{
+    if (allocator->config.placement == OP_PLACE_LIFO)
+    {
+        _free_link_t *links = allocator->free_links;
+        if (links[index].prev != NO_SLOT) { links[links[index].prev].next = links[index].next; }
+        else                              { allocator->free_head = links[index].next; }
+        if (links[index].next != NO_SLOT) { links[links[index].next].prev = links[index].prev; }
+        else                              { allocator->free_tail = links[index].prev; }
+        links[index].prev = links[index].next = NO_SLOT;
+    }
+}
+
+static void relocate_slot(op_allocator allocator, const size_t from, const size_t to,
+                          op_relocate_callback relocate, void *context)
+{
+    _ab_t *source = &allocator->pool[from], *destination = &allocator->pool[to];
+
+    if (allocator->use_chunks && allocator->chunks[destination->chunk].advised)
+    {
+        wake_chunk(allocator, &allocator->chunks[destination->chunk]);
+    }
+
+    if (allocator->config.constructor || allocator->config.destructor)
+    {
+        /* the destination's spare constructed state goes where it will be destroyed with the source chunk */
+        swap_objects(destination->data, source->data, allocator->object_size);
+    }
+    else
+    {
+        memcpy(destination->data, source->data, allocator->object_size);
+    }
+    occupy_slot(allocator, to);
+    vacate_slot(allocator, from);
+
+    relocate(context, source->data, destination->data);
+}
+
+static int compare_free_entry_address(const void *a, const void *b)
+{
+    const _free_entry_t *lhs = a, *rhs = b;
+    return (lhs->data > rhs->data) - (lhs->data < rhs->data);
+}
+
+static void note_availability(op_allocator allocator)
+{
+    size_t available = allocator->backed_objects - allocator->active_objects;
+    if (available < allocator->available_low_water)
+    {
+        allocator->available_low_water = available;
+    }
+    if (allocator->config.bounded_latency && !allocator->growth_requested
+            && (available < allocator->config.low_watermark || available == 0))
+    {
+        allocator->growth_requested = true;
+        allocator->growth_requests++;
+    }
+}
+
+static void count_operation(op_allocator allocator)
+{
+    /* sorting allocates and decay frees, so with bounded latency both are left due for op_ll_maintain() */
+    if (allocator->config.free_list_sort_interval > 0
+            && ++allocator->operations >= allocator->config.free_list_sort_interval
+            && !allocator->config.bounded_latency)
+    {
+        op_ll_optimize_free_list(allocator);
+    }
+    if (allocator->config.decay_ms > 0 && ++allocator->decay_operations >= OP_DECAY_CHECK_INTERVAL
+            && !allocator->config.bounded_latency)
+    {
+        op_ll_decay(allocator);
+    }
+}
+
+static int compare_chunk_occupancy(const void *a, const void *b)
+{
+    const _chunk_t *lhs = *(const _chunk_t * const *) a, *rhs = *(const _chunk_t * const *) b;
+    return (lhs->active > rhs->active) - (lhs->active < rhs->active);
+}
+
+static void evacuate_chunks(op_allocator allocator, _chunk_t **order, const size_t populated,
+                            op_relocate_callback relocate, void *context)
+{
+    qsort(order, populated, sizeof(_chunk_t *), compare_chunk_occupancy);
+
+    /* Evacuate the sparsest chunks into the densest ones for as long as the denser chunks can absorb a whole chunk's
+     * worth of live objects.  Moving only part of a chunk would not let it be freed. */
+    size_t lo = 0, hi = populated ? populated - 1 : 0;
+    while (lo < hi)
+    {
+        _chunk_t *source = order[lo];
+        if (source->active == 0 || source->pinned > 0)
+        {
+            lo++;
+            continue;
+        }
+
+        size_t room = 0;
+        for (size_t t = lo + 1; t <= hi; t++) { room += order[t]->count - order[t]->active; }
+        if (room < source->active)
+        {
+            break;
+        }
+
+        for (size_t from = source->offset; source->active > 0; from++)
+        {
+            if (allocator->pool[from].in_use == IN_USE)
+            {
+                while (order[hi]->active == order[hi]->count) { hi--; }
+                size_t to = order[hi]->offset;
+                while (allocator->pool[to].in_use == IN_USE) { to++; }
+                relocate_slot(allocator, from, to, relocate, context);
+            }
+        }
+        lo++;
+    }
+}
+
+static size_t find_hinted_slot(const op_allocator allocator, const op_ll_lifetime_hint hint, const bool backed)
+{
+    const _chunk_t *match = NULL, *empty = NULL;
+
+    /* the fullest chunk already holding objects of this lifetime, otherwise an empty chunk, preferably still backed */
+    for (size_t c = 0; c < allocator->chunk_count; c++)
+    {
+        const _chunk_t *chunk = &allocator->chunks[c];
+        if (backed && chunk->memory == NULL)
+        {
+            continue;
+        }
+        else if (chunk->active > 0 && chunk->active < chunk->count && chunk->lifetime == hint)
+        {
+            if (match == NULL || chunk->active > match->active) { match = chunk; }
+        }
+        else if (chunk->active == 0 && (empty == NULL || (empty->memory == NULL && chunk->memory != NULL)))
+        {
+            empty = chunk;
+        }
+    }
+
+    return match ? find_free_slot_in_chunk(allocator, match)
+           : empty ? find_free_slot_in_chunk(allocator, empty)
+           : NO_SLOT;
+}
+
+static bool resize_slot_state(op_allocator allocator, const size_t capacity)
+{
+    bool rv = true;
+
+    if (allocator->config.placement == OP_PLACE_LIFO)
+    {
+        _free_link_t *links = realloc(allocator->free_links, capacity * sizeof(_free_link_t));
+        if (links)
+        {
+            allocator->free_links = links;
+        }
+        else
+        {
+            rv = false;
+            op_error_handler(__FILE__, __LINE__, "Could not allocate space for the free list.");
+        }
+    }
+    if (rv && allocator->config.deferred_zeroing)
+    {
+        rv = resize_scrub_space(allocator, capacity);
+    }
+
+    return rv;
+}
+
+static bool resize_scrub_space(op_allocator allocator, const size_t capacity)
+{
+    bool rv = false;
+
+    size_t *queue = malloc(capacity * sizeof(size_t));
+    size_t *stack = realloc(allocator->clean_stack, capacity * sizeof(size_t));
+    uint8_t *flags = realloc(allocator->scrub_flags, capacity);
+    if (stack)
+    {
+        allocator->clean_stack = stack;
+    }
+    if (flags)
+    {
+        allocator->scrub_flags = flags;
+    }
+    if (queue && stack && flags)
+    {
+        for (size_t i = allocator->scrub_capacity; i < capacity; i++)
+        {
+            flags[i] = 0;
+        }
+        /* unroll the ring into the new queue */
+        for (size_t q = 0; q < allocator->scrub_count; q++)
+        {
+            queue[q] = allocator->scrub_queue[(allocator->scrub_head + q) % allocator->scrub_capacity];
+        }
+        free(allocator->scrub_queue);
+        allocator->scrub_queue = queue;
+        allocator->scrub_head = 0;
+        allocator->scrub_capacity = capacity;
+        rv = true;
+    }
+    else
+    {
+        free(queue);
+        op_error_handler(__FILE__, __LINE__, "Could not allocate space for scrubbing.");
+    }
+
+    return rv;
+}
+
+static bool is_dirty(const op_allocator allocator, const size_t index)
+{
+    return allocator->scrub_flags && (allocator->scrub_flags[index] & SCRUB_DIRTY);
+}
+
+static void mark_clean(op_allocator allocator, const size_t index)
+{
+    if (is_dirty(allocator, index))
+    {
+        allocator->scrub_flags[index] &= ~SCRUB_DIRTY;
+        allocator->dirty_objects--;
+    }
+}
+
+static void push_clean_slot(op_allocator allocator, const size_t index)
+{
+    if (!(allocator->scrub_flags[index] & SCRUB_STACKED))
+    {
+        allocator->scrub_flags[index] |= SCRUB_STACKED;
+        allocator->clean_stack[allocator->clean_count++] = index;
+    }
+}
+
+static size_t pop_clean_slot(op_allocator allocator)
+{
+    while (allocator->clean_count > 0)
+    {
+        size_t i = allocator->clean_stack[--allocator->clean_count];
+        _ab_t *slot = &allocator->pool[i];
+        allocator->scrub_flags[i] &= ~SCRUB_STACKED;
+        /* entries go stale when their slot is allocated by other means, or its chunk is released */
+        if (slot->in_use == NOT_IN_USE && !is_dirty(allocator, i) && slot->data != NULL)
+        {
+            return i;
+        }
+    }
+    return NO_SLOT;
+}
+
+static void scrub_object(uint8_t *object, const size_t size)
+{
+#if defined(__SSE2__)
+    if (size >= OP_SCRUB_STREAMING_THRESHOLD)
+    {
+        size_t head = (16 - (uintptr_t) object % 16) % 16;
+        size_t body = (size - head) & ~(size_t) 15;
+        memset(object, 0, head);
+        __m128i zero = _mm_setzero_si128();
+        for (size_t i = head; i < head + body; i += 16)
+        {
+            _mm_stream_si128((__m128i *) (object + i), zero);
+        }
+        memset(object + head + body, 0, size - head - body);
+        _mm_sfence();
+        return;
+    }
+#endif
+    memset(object, 0, size);
+}
+
+static void register_allocator(op_allocator allocator)
+{
+    bool taken = lock_budget();
+    allocator->next_allocator = memory_budget.allocators;
+    memory_budget.allocators = allocator;
+    unlock_budget(taken);
+}
+
+static void unregister_allocator(op_allocator allocator)
+{
+    bool taken = lock_budget();
+    for (op_allocator *link = &memory_budget.allocators; *link != NULL; link = &(*link)->next_allocator)
+    {
+        if (*link == allocator)
+        {
+            *link = allocator->next_allocator;
+            break;
+        }
+    }
+    unlock_budget(taken);
+}
+
+/* the caller holds the budget lock */
+static size_t trim_allocators(void)
+{
+    size_t before = memory_budget.bytes;
+
+    /* only memory holding no live objects is given back, so nothing moves and no caller's pointers go stale; other
+     * allocators may be in use by other threads at this very moment, so they are left alone */
+    for (op_allocator allocator = memory_budget.allocators; allocator != NULL; allocator = allocator->next_allocator)
+    {
+        if (allocator->config.trim_on_pressure && !allocator->keep_on_trim)
+        {
+            op_ll_compact(allocator, NULL, NULL);
+        }
+    }
+
+    size_t after = memory_budget.bytes;
+    return before > after ? before - after : 0;
+}
+
+static bool lock_budget(void)
+{
+    bool rv = false;
+
+#if OP_CAN_THREAD
+    if (!budget_held)
+    {
+        pthread_mutex_lock(&budget_lock);
+        budget_held = true;
+        rv = true;
+    }
+#endif
+
+    return rv;
+}
+
+static void unlock_budget(const bool taken)
+{
+#if OP_CAN_THREAD
+    if (taken)
+    {
+        budget_held = false;
+        pthread_mutex_unlock(&budget_lock);
+    }
+#else
+    UNUSED(taken);
+#endif
+}
+
+static void check_memory_budget(void)
+{
+    /* Only a crossed watermark takes the lock, so allocators on different threads do not contend for it while the
+     * total stays on one side.  The crossing is confirmed under the lock, since another thread may have got there
+     * first, and the callback is made once the lock has been released. */
+    size_t high = memory_budget.high_watermark, bytes = memory_budget.bytes;
+    if (high != 0 && !budget_notifying
+            && (memory_budget.above ? bytes <= memory_budget.low_watermark : bytes > high))
+    {
+        bool raised = false, lowered = false;
+        bool taken = lock_budget();
+        op_pressure_callback callback = memory_budget.callback;
+        void *context = memory_budget.context;
+        if (memory_budget.high_watermark != 0 && !memory_budget.checking)
+        {
+            /* trimmed allocators check the budget as they compact; the flag keeps them from recursing */
+            memory_budget.checking = true;
+            if (!memory_budget.above && memory_budget.bytes > memory_budget.high_watermark)
+            {
+                memory_budget.above = raised = true;
+                trim_allocators();
+            }
+            if (memory_budget.above && memory_budget.bytes <= memory_budget.low_watermark)
+            {
+                memory_budget.above = false;
+                lowered = true;
+            }
+            memory_budget.checking = false;
+        }
+        unlock_budget(taken);
+
+        if (raised)  { notify_pressure(callback, context, OP_PRESSURE_HIGH); }
+        if (lowered) { notify_pressure(callback, context, OP_PRESSURE_LOW); }
+    }
+}
+
+static void notify_pressure(op_pressure_callback callback, void *context, const op_ll_pressure_level level)
+{
+    /* the callback may allocate and deallocate, which does not trigger further callbacks on this thread */
+    if (callback)
+    {
+        bool notifying = budget_notifying;
+        budget_notifying = true;
+        callback(context, level, memory_budget.bytes);
+        budget_notifying = notifying;
+    }
+}
+
+static bool read_memory_pressure(const double psi_threshold)
+{
+    bool rv = false;
+
+#if defined(__linux__)
+    /* pressure stall information: the share of the last ten seconds some task spent waiting on memory */
+    FILE *psi = fopen("/proc/pressure/memory", "r");
+    if (psi)
+    {
+        double avg10;
+        if (fscanf(psi, "some avg10=%lf", &avg10) == 1 && avg10 > psi_threshold)
+        {
+            rv = true;
+        }
+        fclose(psi);
+    }
+
+    /* cgroup v2: the kernel throttled or reclaimed at the group's memory.high or memory.max since the last poll */
+    FILE *events = fopen("/sys/fs/cgroup/memory.events", "r");
+    if (events)
+    {
+        char name[32];
+        size_t count, total = 0;
+        while (fscanf(events, "%31s %zu", name, &count) == 2)
+        {
+            if (strcmp(name, "high") == 0 || strcmp(name, "max") == 0)
+            {
+                total += count;
+            }
+        }
+        if (memory_budget.cgroup_polled && total > memory_budget.cgroup_events)
+        {
+            rv = true;
+        }
+        memory_budget.cgroup_events = total;
+        memory_budget.cgroup_polled = true;
+        fclose(events);
+    }
+#else
+    UNUSED(psi_threshold);
+#endif
+
+    return rv;
+}
+
+#if OP_CAN_TRACE
+/* called by TRACE() once it has seen a trace running */
+static void trace(op_allocator allocator, const op_trace_event event, const size_t slot)
+{
+    _trace_ring_t *ring = trace_ring ? trace_ring : attach_trace_ring();
+    uint64_t head = ring ? atomic_load_explicit(&ring->head, memory_order_relaxed) : 0;
+
+    /* tail only grows, so the space seen at the last look is still free and the flusher's tail is read once a ring */
+    if (ring && head >= ring->limit)
+    {
+        ring->limit = atomic_load_explicit(&ring->tail, memory_order_acquire) + OP_TRACE_RING_RECORDS;
+    }
+    bool room = ring && head < ring->limit;
+    if (ring && !room && !atomic_flag_test_and_set_explicit(&ring->flushing, memory_order_acquire))
+    {
+        /* full: write it out here rather than wait for op_ll_trace_flush(), unless that is at it already */
+        if (atomic_load(&trace_state.active))
+        {
+            drain_trace_ring(ring);
+            ring->limit = head + OP_TRACE_RING_RECORDS;
+            room = true;
+        }
+        atomic_flag_clear_explicit(&ring->flushing, memory_order_release);
+    }
+
+    if (room)
+    {
+        uint32_t id = atomic_load_explicit(&allocator->trace_id, memory_order_relaxed);
+        if (id == 0)
+        {
+            uint32_t fresh = atomic_fetch_add(&trace_state.next_allocator, 1) + 1;
+            id = atomic_compare_exchange_strong(&allocator->trace_id, &id, fresh) ? fresh : id;
+        }
+        ring->records[head % OP_TRACE_RING_RECORDS] = (op_trace_record)
+        {
+            .timestamp = trace_ticks(),
+            .allocator = id,
+            .slot = slot < UINT32_MAX ? (uint32_t) slot : UINT32_MAX,
+            .thread = ring->thread,
+            .event = event,
+        };
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    }
+    else
+    {
+        atomic_fetch_add_explicit(&trace_state.dropped, 1, memory_order_relaxed);
+    }
+}
+
+static _trace_ring_t *attach_trace_ring(void)
+{
+    _trace_ring_t *rv = calloc(1, sizeof(_trace_ring_t));
+
+    if (rv)
+    {
+        atomic_flag_clear(&rv->flushing);
+        rv->thread = atomic_fetch_add(&trace_state.next_thread, 1) + 1;
+        rv->next = atomic_load(&trace_state.rings);
+        while (!atomic_compare_exchange_weak(&trace_state.rings, &rv->next, rv)) { }
+        trace_ring = rv;
+    }
+
+    return rv;
+}
+
+/* the caller holds the ring's flushing flag */
+static void drain_trace_ring(_trace_ring_t *ring)
+{
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    int fd = atomic_load(&trace_state.fd);
+
+    /* the records wrap around the end of the ring at most once */
+    size_t first = (size_t) (tail % OP_TRACE_RING_RECORDS);
+    size_t count = (size_t) (head - tail);
+    size_t before_wrap = count < OP_TRACE_RING_RECORDS - first ? count : OP_TRACE_RING_RECORDS - first;
+    size_t bytes = count * sizeof(op_trace_record);
+    if (count > 0 && fd >= 0)
+    {
+        off_t offset = (off_t) atomic_fetch_add(&trace_state.offset, bytes);
+        size_t split = before_wrap * sizeof(op_trace_record);
+        bool written = pwrite(fd, &ring->records[first], split, offset) == (ssize_t) split
+                       && (split == bytes
+                           || pwrite(fd, ring->records, bytes - split, offset + (off_t) split) == (ssize_t) (bytes - split));
+        if (written)
+        {
+            atomic_fetch_add(&trace_state.records, count);
+        }
+        else
+        {
+            atomic_store(&trace_state.failed, true);
+        }
+    }
+    atomic_store_explicit(&ring->tail, head, memory_order_release);
+}
+
+static uint64_t trace_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return trace_ns();
+#endif
+}
+
+static uint64_t trace_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+#endif
+
+/*******************************************************************************
+* Weakly-linked function implementations.
+*******************************************************************************/
 
 __attribute((weak)) void op_error_handler(const char *file, const int line, const char *error_message)
 {
@@ -331,6 +3711,17 @@ __attribute((weak)) void op_error_handler(const char *file, const int line, cons
     UNUSED(error_message);
 }
 
+__attribute((weak)) uint64_t op_time_ms(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+#else
+    return (uint64_t) clock() * 1000 / CLOCKS_PER_SEC;
+#endif
+}
+
 /*******************************************************************************
 * Concealed function used for debugging purposes only.
 *******************************************************************************/
@@ -340,18 +3731,26 @@ __attribute((weak)) void op_error_handler(const char *file, const int line, cons
 void dump_allocator(op_allocator allocator)
 {
     fprintf(stderr, "object_size = %lu\n", allocator->object_size);
+    fprintf(stderr, "stride = %lu\n", allocator->stride);
     fprintf(stderr, "initial_count = %lu\n", allocator->initial_count);
     fprintf(stderr, "maximum_objects = %lu\n", allocator->maximum_objects);
+    fprintf(stderr, "active_objects = %lu\n", allocator->active_objects);
     fprintf(stderr, "use_chunks = %d\n", allocator->use_chunks);
     fprintf(stderr, "use_linear = %d\n", allocator->use_linear);
     fprintf(stderr, "initialized = %d\n", allocator->initialized);
     fprintf(stderr, "pool = %p\n", allocator->pool);
+    for (size_t c = 0; c < allocator->chunk_count; c++)
+    {
+        _chunk_t *chunk = &allocator->chunks[c];
+        fprintf(stderr, "\tchunk %lu - %p [%lu, %lu) active %lu pinned %lu\n", c, chunk->memory, chunk->offset,
+                chunk->offset + chunk->count, chunk->active, chunk->pinned);
+    }
     for (size_t i = 0; i < allocator->maximum_objects; i++)
     {
-        _ab_t *ab = allocator->pool[i];
-        if (ab != NULL)
+        _ab_t *ab = &allocator->pool[i];
+        if (ab->data != NULL)
         {
-            fprintf(stderr, "\t%lu - %p -> %d %p\n", i, allocator->pool[i], allocator->pool[i]->in_use, allocator->pool[i]->data);
+            fprintf(stderr, "\t%lu - %d%s %p\n", i, ab->in_use, ab->pinned ? " pinned" : "", ab->data);
         }
         else
         {
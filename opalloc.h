@@ -29,6 +29,35 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+/** @brief Defined to 1 where the I/O buffer functions taking `struct iovec` are available. */
+#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__)
+#include <sys/uio.h>
+#define OP_HAVE_IOVEC 1
+#else
+#define OP_HAVE_IOVEC 0
+#endif
+
+/** @brief Cache line size assumed for cache coloring and padding. */
+#if !defined(OP_CACHE_LINE_SIZE)
+#define OP_CACHE_LINE_SIZE 64
+#endif
+
+/** @brief Number of distinct cache line offsets cycled through by cache coloring. */
+#if !defined(OP_CACHE_COLORS)
+#define OP_CACHE_COLORS 8
+#endif
+
+/** @brief Defined to 1 to compile in allocation tracing; see `op_ll_trace_start()`. */
+#if !defined(OP_TRACE)
+#define OP_TRACE 0
+#endif
+
+/** @brief Records held per thread before tracing has to flush or drop them; a power of two. */
+#if !defined(OP_TRACE_RING_RECORDS)
+#define OP_TRACE_RING_RECORDS 4096
+#endif
 
 /** @defgroup llinterface Low-level interface
  *
@@ -52,17 +81,126 @@ typedef enum op_ll_allocator_mode
     OP_LINEAR_CHUNK,        /**< linear growth, chunk object allocation        */
 } op_ll_allocator_mode;
 
+/** @brief Where a new object is placed among the free slots. */
+typedef enum op_ll_placement_policy
+{
+    OP_PLACE_LOWEST_INDEX,    /**< lowest-index free slot                          */
+    OP_PLACE_MOST_FULL,       /**< free slot in the fullest chunk with room        */
+    OP_PLACE_LIFO,            /**< most recently freed slot                        */
+    OP_PLACE_ADDRESS_ORDERED, /**< free slot with the lowest address               */
+} op_ll_placement_policy;
+
+/** @brief Expected lifetime of an object, used to segregate objects by chunk. */
+typedef enum op_ll_lifetime_hint
+{
+    OP_HINT_NONE,        /**< no expectation, the object may share any chunk */
+    OP_HINT_SHORT_LIVED, /**< the object is expected to be freed soon        */
+    OP_HINT_LONG_LIVED,  /**< the object is expected to live for a long time */
+} op_ll_lifetime_hint;
+
+/** @brief What allocation does once an allocator reaches its capacity limits. */
+typedef enum op_ll_overflow_policy
+{
+    OP_OVERFLOW_FAIL,    /**< return NULL                                       */
+    OP_OVERFLOW_RESERVE, /**< take an object from a pre-filled emergency reserve */
+    OP_OVERFLOW_MALLOC,  /**< take an object from malloc and keep track of it   */
+} op_ll_overflow_policy;
+
+/** @brief Direction in which the process-wide memory budget was crossed. */
+typedef enum op_ll_pressure_level
+{
+    OP_PRESSURE_HIGH, /**< above the high watermark, after idle memory was trimmed */
+    OP_PRESSURE_LOW,  /**< back at or below the low watermark                      */
+} op_ll_pressure_level;
+
+/** @brief Memory pressure callback.
+ *
+ * @param [in] context      The context given to `op_ll_set_memory_budget()`.
+ * @param [in] level        Which watermark was crossed.
+ * @param [in] bytes_in_use The bytes backing objects across all allocators.
+ */
+typedef void (*op_pressure_callback)(void *context, op_ll_pressure_level level, size_t bytes_in_use);
+
+/** @brief Constructor or destructor hook for objects of an allocator.
+ *
+ * @param [in] context The `hook_context` of the allocator's configuration.
+ * @param [in] object  The object to be constructed or destroyed.
+ */
+typedef void (*op_object_hook)(void *context, void *object);
+
+/** @brief Optional allocator configuration.
+ *
+ * Always start from `op_ll_default_allocator_config()` and change only the
+ * fields of interest so that future fields keep their defaults.
+ */
+typedef struct op_allocator_config
+{
+    op_ll_placement_policy placement;               /**< free slot selection, OP_PLACE_LOWEST_INDEX by default */
+    size_t                 free_list_sort_interval; /**< operations between free list sorts, 0 (never) by default */
+    bool                   cache_coloring;          /**< offset successive chunks by cache lines, false by default */
+    bool                   cache_line_padding;      /**< give each object its own cache lines, false by default    */
+    op_object_hook         constructor;             /**< run once when an object's memory is created, or NULL      */
+    op_object_hook         destructor;              /**< run once before an object's memory is freed, or NULL      */
+    void                  *hook_context;            /**< passed to the constructor and destructor                  */
+    bool                   deferred_zeroing;        /**< zero freed objects in `op_ll_scrub()`, false by default   */
+    bool                   bounded_latency;         /**< only `op_ll_maintain()` grows the pool, false by default  */
+    size_t                 low_watermark;           /**< free objects below which growth is requested, 0 by default */
+    size_t                 high_watermark;          /**< free objects `op_ll_maintain()` restores, 0 by default    */
+    size_t                 max_objects;             /**< most objects the pool may hold, 0 (unlimited) by default  */
+    size_t                 max_bytes;               /**< most bytes the pool may hold, 0 (unlimited) by default    */
+    op_ll_overflow_policy  overflow;                /**< behaviour past the limits, OP_OVERFLOW_FAIL by default    */
+    size_t                 reserve_count;           /**< objects in the emergency reserve, 0 by default            */
+    size_t                 decay_ms;                /**< time empty chunks are kept, 0 (until compacted) by default */
+    bool                   advise_release;          /**< hand back pages of empty chunks, false by default         */
+    size_t                 init_threads;            /**< threads initializing large chunks, 1 by default           */
+    bool                   clonable;                /**< back chunks with files for op_ll_clone(), false by default */
+    bool                   io_buffers;              /**< page-aligned slots in chunks that stay put, false by default */
+    bool                   trim_on_pressure;        /**< compacted by budget trims, false by default               */
+} op_allocator_config;
+
 /** @brief Opaque allocator handle permitting multiple object pools. */
 typedef struct _op_allocator *op_allocator;
 
 /** @brief Stats for measuring and debugging allocators. */
 typedef struct op_allocator_stats
 {
-    size_t object_size;     /**< size in bytes of stored objects                   */
-    size_t maximum_objects; /**< maximum number of objects currently allocated for */
-    size_t active_objects;  /**< number of objects actively in use                 */
+    size_t object_size;           /**< size in bytes of stored objects                     */
+    size_t maximum_objects;       /**< maximum number of objects currently allocated for   */
+    size_t active_objects;        /**< number of objects actively in use                   */
+    size_t slot_stride;           /**< distance in bytes between neighbouring objects      */
+    size_t padding_bytes;         /**< bytes held for padding rather than objects          */
+    size_t dirty_objects;         /**< free objects waiting to be zeroed                   */
+    size_t inline_zeroings;       /**< allocations which had to zero an object first       */
+    size_t available_objects;     /**< free objects ready to allocate without growth       */
+    size_t available_low_water;   /**< fewest available objects since the last maintenance */
+    size_t growth_requests;       /**< times the pool fell below the low watermark         */
+    size_t exhausted_allocations; /**< allocations that failed awaiting maintenance        */
+    bool   growth_pending;        /**< growth was requested and not yet carried out        */
+    size_t reserve_objects;       /**< objects taken from the emergency reserve            */
+    size_t spilled_objects;       /**< objects taken from malloc past the limits           */
+    size_t spilled_bytes;         /**< bytes taken from malloc past the limits             */
+    size_t capped_allocations;    /**< allocations made while at the capacity limits       */
+    size_t decayed_chunks;        /**< empty chunks released after decaying                */
+    size_t reserved_bytes;        /**< bytes of slots backed by memory                     */
+    size_t resident_bytes;        /**< reserved bytes not handed back to the kernel        */
 } op_allocator_stats;
 
+/** @brief Relocation callback used while compacting an allocator.
+ *
+ * @param [in] context    The caller-supplied context given to `op_ll_compact()`.
+ * @param [in] old_object The object's previous location.
+ * @param [in] new_object The object's new location, already holding its contents.
+ *
+ * The callback must redirect every reference to `old_object` towards
+ * `new_object`.  The old location stays readable until `op_ll_compact()`
+ * returns.
+ *
+ * @note For allocators with a constructor or destructor the contents of the
+ *       two locations are exchanged rather than copied, so the old location
+ *       holds the spare constructed object previously at the new one.
+ */
+typedef void (*op_relocate_callback)(void *context, void *old_object, void *new_object);
+
 /** @brief Error callback for allocator errors.
  *
  * @param [in] file          The source file where the error was discovered.
@@ -74,6 +212,15 @@ typedef struct op_allocator_stats
  */
 void op_error_handler(const char *file, const int line, const char *error_message);
 
+/** @brief Monotonic clock used to decay idle chunks.
+ *
+ * @return The current time in milliseconds, from an arbitrary starting point.
+ *
+ * A weakly-linked implementation based on `CLOCK_MONOTONIC` is provided.
+ * Replace it where that clock is unavailable or too costly.
+ */
+uint64_t op_time_ms(void);
+
 /** @brief Allocate an object in the given allocator context.
  *
  * @param [in,out] allocator The allocator from which the memory is to be allocated.
@@ -84,6 +231,48 @@ void op_error_handler(const char *file, const int line, const char *error_messag
  */
 void *op_ll_allocate_object(op_allocator allocator);
 
+/** @brief Allocate an object in the given allocator context, grouped by lifetime.
+ *
+ * @param [in,out] allocator The allocator from which the memory is to be allocated.
+ * @param [in]     hint      The expected lifetime of the object.
+ *
+ * @return A pointer to the memory space, NULL on failure.
+ *
+ * Objects allocated with a hint are only placed in chunks holding objects
+ * with the same hint, or in empty chunks, growing the pool if neither has
+ * room.  Long-lived objects therefore do not keep chunks of churning
+ * short-lived objects from emptying, and `op_ll_compact()` only moves objects
+ * between chunks of the same lifetime.  A pool which has reached
+ * `max_objects` or `max_bytes` places the object in any free slot instead,
+ * without changing the lifetime of the chunk it shares, and only follows
+ * `overflow` when it has no free slot at all.
+ *
+ * @note 1. `OP_HINT_NONE` is the same as `op_ll_allocate_object()`; such
+ *          objects follow the placement policy and may share any chunk.
+ *       2. Without chunk allocation every object has its own memory and the
+ *          hint is ignored.
+ *       3. The `op_error_handler()` callback is called before NULL is returned.
+ */
+void *op_ll_allocate_object_hint(op_allocator allocator, const op_ll_lifetime_hint hint);
+
+/** @brief Allocate an object as close as possible to an existing one.
+ *
+ * @param [in,out] allocator The allocator from which the memory is to be allocated.
+ * @param [in]     neighbor  An object of the same allocator to allocate next to.
+ *
+ * @return A pointer to the memory space, NULL on failure.
+ *
+ * The free slot of the neighbor's chunk closest to the neighbor is used, so
+ * that linked structures such as trees keep parents and children on the same
+ * cache lines or pages.  If the neighbor's chunk is full, this is the same as
+ * `op_ll_allocate_object()`.
+ *
+ * @note 1. Without chunk allocation, or if `neighbor` was not allocated from
+ *          `allocator`, this is the same as `op_ll_allocate_object()`.
+ *       2. The `op_error_handler()` callback is called before NULL is returned.
+ */
+void *op_ll_allocate_near(op_allocator allocator, const void *neighbor);
+
 /** @brief Deallocate a specified object from the given allocator.
  *
  * @param [in, out] allocator The allocator holding the object being freed.
@@ -91,6 +280,433 @@ void *op_ll_allocate_object(op_allocator allocator);
  */
 void op_ll_deallocate_object(op_allocator allocator, const void *object);
 
+/** @brief Pin or unpin an object so that compaction leaves it in place.
+ *
+ * @param [in, out] allocator The allocator holding the object.
+ * @param [in]      object    The object to be pinned or unpinned.
+ * @param [in]      pinned    Whether the object is to be kept in place.
+ *
+ * @note Deallocating an object unpins it.
+ */
+void op_ll_pin_object(op_allocator allocator, const void *object, const bool pinned);
+
+/** @brief Concentrate live objects and free the chunks this empties.
+ *
+ * @param [in, out] allocator The allocator to compact.
+ * @param [in]      relocate  Callback told of every object moved, or NULL.
+ * @param [in]      context   Passed through to `relocate`.
+ *
+ * @return The number of chunks (or, without chunk allocation, individual
+ *         objects) whose memory was freed.
+ *
+ * Live objects are moved out of the sparsest chunks into free slots of the
+ * densest ones, sparsest chunk first, as long as a whole chunk can be emptied.
+ * Chunks holding pinned objects are never emptied.  Every chunk left without
+ * live objects is then freed; its slots remain in the pool and are backed
+ * again the next time one of them is allocated.
+ *
+ * @note 1. With a NULL `relocate` no object is moved and only chunks which are
+ *          already empty are freed.
+ *       2. Without chunk allocation objects are never moved; unused objects are
+ *          freed instead.
+ *       3. With `io_buffers` objects are never moved either, and chunks are
+ *          only handed back if `advise_release` is also set.
+ */
+size_t op_ll_compact(op_allocator allocator, op_relocate_callback relocate, void *context);
+
+/** @brief Release chunks which have been empty for longer than the decay time.
+ *
+ * @param [in, out] allocator The allocator whose empty chunks are to be released.
+ *
+ * @return The number of chunks released.
+ *
+ * Releasing empty chunks only once they have stayed empty for `decay_ms`
+ * milliseconds avoids freeing and reallocating them over and over when the
+ * load dips briefly, while still giving the memory back after the load has
+ * really changed.  Allocation and deallocation call this every
+ * `OP_DECAY_CHECK_INTERVAL` operations, or leave it to `op_ll_maintain()`
+ * with `bounded_latency`, so this only needs calling from a maintenance point
+ * in allocators that can go idle.
+ *
+ * @note 1. This does nothing unless `decay_ms` is configured and the allocator
+ *          uses chunk allocation.
+ *       2. Time is taken from `op_time_ms()`.
+ */
+size_t op_ll_decay(op_allocator allocator);
+
+/** @brief Zero deallocated objects ahead of their reuse.
+ *
+ * @param [in, out] allocator The allocator whose deallocated objects are to be zeroed.
+ * @param [in]      budget    The maximum number of objects to zero.
+ *
+ * @return The number of objects zeroed.
+ *
+ * Objects are zeroed in the order they were deallocated.  Objects of at least
+ * `OP_SCRUB_STREAMING_THRESHOLD` bytes are zeroed with non-temporal stores
+ * where available, so scrubbing does not evict the cache.
+ *
+ * @note 1. This does nothing unless `deferred_zeroing` is configured.
+ *       2. Allocators are not thread-safe.  To scrub from a background thread,
+ *          serialize this call with every other use of the allocator.
+ */
+size_t op_ll_scrub(op_allocator allocator, const size_t budget);
+
+/** @brief Grow a bounded-latency allocator ahead of demand.
+ *
+ * @param [in, out] allocator The allocator to be maintained.
+ *
+ * @return True if the allocator holds at least the configured watermark of
+ *         available objects afterwards, false if memory ran out first.
+ *
+ * A free list sort or decay check which allocation left due is carried out
+ * first.  Memory released by `op_ll_compact()` is restored next, then the
+ * pool is grown until `high_watermark` objects (or `low_watermark`, if
+ * higher, or one if neither is set) are available.  This clears
+ * `growth_pending` and resets `available_low_water` in the allocator's stats.
+ *
+ * @note 1. This is meant for allocators configured with `bounded_latency`,
+ *          where it is the only way the pool grows.  Call it from an idle
+ *          point of the main loop, or poll `op_ll_growth_pending()`.
+ *       2. Allocators are not thread-safe.  To maintain from a background
+ *          thread, serialize this call with every other use of the allocator.
+ */
+bool op_ll_maintain(op_allocator allocator);
+
+/** @brief Check whether an allocator has growth waiting for maintenance.
+ *
+ * @param [in] allocator The allocator to check.
+ *
+ * @return `growth_pending` from the allocator's stats, without gathering the
+ *         rest of them, so it is cheap enough to poll after every operation.
+ */
+bool op_ll_growth_pending(const op_allocator allocator);
+
+/** @brief Sort the free list of an allocator into address order.
+ *
+ * @param [in, out] allocator The allocator whose free list is to be sorted.
+ *
+ * After long runs of interlaced allocation and deallocation the free list of an
+ * `OP_PLACE_LIFO` allocator hands out slots in scattered order, so consecutive
+ * allocations land on different pages.  Sorting restores contiguous
+ * allocation bursts until the list is scattered again.
+ *
+ * @note 1. Setting `free_list_sort_interval` in the allocator's configuration
+ *          calls this automatically every that many allocations and
+ *          deallocations, or from `op_ll_maintain()` with `bounded_latency`.
+ *       2. Other placement policies derive their order from the index and are
+ *          not affected.
+ */
+void op_ll_optimize_free_list(op_allocator allocator);
+
+/** @brief Set a memory budget spanning every allocator in the process.
+ *
+ * @param [in] high_watermark Bytes above which memory is trimmed and the
+ *                            callback notified, or 0 to remove the budget.
+ * @param [in] low_watermark  Bytes at or below which the callback is notified
+ *                            that the pressure has passed.
+ * @param [in] callback       Called on crossing either watermark, or NULL.
+ * @param [in] context        Passed to the callback.
+ *
+ * Bytes are counted as the slots backed by memory in every allocator, plus
+ * objects spilled to malloc.  When an allocation takes the total above
+ * `high_watermark`, allocators are trimmed as by `op_ll_trim()` and the
+ * callback is told `OP_PRESSURE_HIGH`, so the application can shed caches of
+ * its own.  Once compaction or de-initialization brings the total down to
+ * `low_watermark`, the callback is told `OP_PRESSURE_LOW`.
+ *
+ * @note 1. The callback may allocate and deallocate, but this does not
+ *          trigger further callbacks on its thread until it returns.
+ *       2. The budget is thread-safe: allocators used by different threads
+ *          may count against it.  Allocations only contend for its lock
+ *          when they cross a watermark, and the callback runs on the thread
+ *          which crossed it once the lock has been released, so it may wait
+ *          on other threads which allocate.  Callbacks for successive
+ *          crossings can therefore overlap on different threads.
+ */
+void op_ll_set_memory_budget(const size_t high_watermark, const size_t low_watermark,
+                             op_pressure_callback callback, void *context);
+
+/** @brief Report the bytes backing objects across all allocators.
+ *
+ * @return The bytes counted against the memory budget.
+ */
+size_t op_ll_memory_in_use(void);
+
+/** @brief Give idle memory of allocators back to the system.
+ *
+ * @return The bytes given back.
+ *
+ * Every allocator configured with `trim_on_pressure` is compacted without
+ * relocation, which frees chunks holding no objects and unused individually
+ * allocated objects.  Other allocators, and emergency reserves, are left
+ * alone.
+ *
+ * @note Trimming also happens when the memory budget's high watermark is
+ *       crossed and in `op_ll_poll_memory_pressure()`, on whichever thread
+ *       does so, and it compacts allocators from that thread.  Allocators are
+ *       not thread-safe, so only set `trim_on_pressure` on allocators used by
+ *       the same single thread as every call which may trim, or serialize
+ *       all their use with those calls.
+ */
+size_t op_ll_trim(void);
+
+/** @brief Check the system for memory pressure and trim if there is any.
+ *
+ * @param [in] psi_threshold The share of time, in percent, that tasks stalled
+ *                           on memory over the last ten seconds above which
+ *                           there is pressure.
+ *
+ * @return True if pressure was found, in which case allocators were trimmed
+ *         as by `op_ll_trim()` and the budget callback told
+ *         `OP_PRESSURE_HIGH`.
+ *
+ * On Linux this reads pressure stall information from `/proc/pressure/memory`
+ * and, for cgroup v2, counts the `high` and `max` events in
+ * `/sys/fs/cgroup/memory.events`.  Any new events since the previous poll
+ * count as pressure.  Elsewhere, or where neither file exists, it always
+ * returns false.
+ *
+ * @note Call this periodically, for example from the same idle point as
+ *       `op_ll_maintain()`.
+ */
+bool op_ll_poll_memory_pressure(const double psi_threshold);
+
+/** @brief Handle returned for objects not allocated from an allocator. */
+#define OP_NO_HANDLE SIZE_MAX
+
+#if OP_HAVE_IOVEC
+/** @brief Allocate a batch of objects as a scatter-gather list.
+ *
+ * @param [in, out] allocator The allocator to allocate the objects from.
+ * @param [out]     iov       Receives an object and its size per entry.
+ * @param [in]      count     The number of objects to allocate.
+ *
+ * @return True if all `count` objects were allocated, which an empty batch
+ *         always is.  On failure none are.
+ *
+ * The list can be passed to `readv()` or `writev()` as is.  It is meant for
+ * allocators configured with `io_buffers`, but works with any.
+ */
+bool op_ll_allocate_iovec(op_allocator allocator, struct iovec *iov, const size_t count);
+
+/** @brief Return a batch of objects allocated with `op_ll_allocate_iovec()`.
+ *
+ * @param [in, out] allocator The allocator the objects came from.
+ * @param [in]      iov       The objects.
+ * @param [in]      count     The number of entries in `iov`.
+ */
+void op_ll_deallocate_iovec(op_allocator allocator, const struct iovec *iov, const size_t count);
+
+/** @brief Describe the memory of an allocator's chunks.
+ *
+ * @param [in]  allocator The allocator to describe.
+ * @param [out] regions   Receives the slots of one chunk per entry; a chunk
+ *                        which has been released is described as NULL with
+ *                        length 0.
+ * @param [in]  capacity  The number of entries `regions` has room for.
+ *
+ * @return The number of chunks, which may be more than `capacity`.  Zero
+ *         without chunk allocation.
+ *
+ * Chunks are only ever added at the end, so after growth the existing
+ * entries are unchanged and new ones follow.  With `io_buffers` the regions
+ * can be registered with `io_uring_register_buffers()` and, after growth, new
+ * ones added with `io_uring_register_buffers_update_tag()`.
+ */
+size_t op_ll_chunk_regions(const op_allocator allocator, struct iovec *regions, const size_t capacity);
+#endif
+
+/** @brief Find which region from `op_ll_chunk_regions()` holds an object.
+ *
+ * @param [in] allocator The allocator the object belongs to.
+ * @param [in] object    The object.
+ *
+ * @return The index of the object's chunk, or `OP_NO_HANDLE` if the object is
+ *         not from this allocator's chunks.  This is the buffer index for
+ *         io_uring fixed buffer operations when every region is registered.
+ */
+size_t op_ll_object_region(const op_allocator allocator, const void *object);
+
+/** @brief Turn an object into a handle which survives snapshots.
+ *
+ * @param [in] allocator The allocator the object was allocated from.
+ * @param [in] object    The object.
+ *
+ * @return The object's slot index, or `OP_NO_HANDLE` if the object is not in
+ *         use in this allocator.
+ *
+ * Objects keep their handles for as long as they stay allocated, and across
+ * `op_ll_snapshot()` and `op_ll_restore()`, but not across relocation by
+ * `op_ll_compact()`.  References stored inside objects should therefore be
+ * handles rather than pointers if the objects are to be snapshotted.
+ */
+size_t op_ll_object_handle(const op_allocator allocator, const void *object);
+
+/** @brief Turn a handle back into an object.
+ *
+ * @param [in] allocator The allocator the handle belongs to.
+ * @param [in] handle    A handle from `op_ll_object_handle()`.
+ *
+ * @return The object, or NULL if the handle is not of an object in use.
+ */
+void *op_ll_object_from_handle(const op_allocator allocator, const size_t handle);
+
+/** @brief Write an allocator's objects and their occupancy to a file.
+ *
+ * @param [in] allocator The allocator to be snapshotted.
+ * @param [in] fd        A file descriptor open for writing, at the start of
+ *                       the file.
+ *
+ * @return True on success, false if the allocator has no chunks or writing
+ *         failed.
+ *
+ * The file holds a header describing the layout, a record for every chunk,
+ * a state byte for every slot and the contents of every chunk, each chunk
+ * starting on a page boundary.  Integers are written in the byte order of the
+ * machine, so snapshots are only meant to be restored on the same kind of
+ * machine.
+ *
+ * @note 1. Only chunk allocators can be snapshotted.  Objects taken from an
+ *          emergency reserve or from malloc are not included.
+ *       2. Pointers stored inside objects are not adjusted; use handles.
+ */
+bool op_ll_snapshot(const op_allocator allocator, int fd);
+
+/** @brief Re-create an allocator from a snapshot file.
+ *
+ * @param [in] path The snapshot file written by `op_ll_snapshot()`.
+ *
+ * @return An `op_allocator` handle holding the snapshotted objects, or NULL on
+ *         failure.
+ *
+ * Each chunk is mapped from the file privately, so pages are only read in as
+ * objects are touched, and changes are copy-on-write and never reach the
+ * file.  Every object keeps its handle and its pin.
+ *
+ * @note The restored allocator uses the default configuration, apart from the
+ *       cache coloring, padding and I/O buffer mode recorded in the layout.
+ *       Hooks are not run, so objects are restored in exactly the state they
+ *       were saved in.
+ */
+op_allocator op_ll_restore(const char *path);
+
+/** @brief Open a persistent pool kept in a memory-mapped file.
+ *
+ * @param [in] path          The pool's file, created if it does not exist.
+ * @param [in] object_size   The size of each object, which must match the
+ *                           size the file was created with.
+ * @param [in] initial_count The size of the first chunk of a new file.
+ * @param [in] mode          `OP_DOUBLING_CHUNK` or `OP_LINEAR_CHUNK` for a
+ *                           new file.
+ *
+ * @return An `op_allocator` handle or NULL on failure.
+ *
+ * Every chunk lives in a region of the file mapped shared, and the state of
+ * every slot is kept in the file next to it, so objects and their occupancy
+ * are updated in place at allocation speed.  Opening the file again, from
+ * this or another run, brings back every allocated object under the same
+ * handle.  The file holds only offsets and can be mapped at any address.
+ *
+ * Updates are ordered so that a crash of the process at any point leaves a
+ * consistent pool: objects are zeroed before they are marked in use, and a
+ * new chunk is written and synced before the file's header counts it.  To
+ * survive a crash of the whole system, call `op_ll_sync()` at points which
+ * must be durable.
+ *
+ * @note 1. The pool uses the default configuration and grows as configured
+ *          when the file was created.
+ *       2. Compaction never moves objects or gives chunks back, since
+ *          neither could be made crash-consistent.
+ *       3. Pointers stored inside objects do not survive reopening; use
+ *          handles from `op_ll_object_handle()`.
+ *       4. A file may be open in only one allocator at a time.  The file is
+ *          locked with `flock()` while it is open, and opening it again
+ *          fails.
+ *       5. A new file needs an `initial_count` above zero.  If creating it
+ *          fails, no file is left behind.
+ */
+op_allocator op_ll_open_persistent(const char *path, const size_t object_size, const size_t initial_count,
+                                   const op_ll_allocator_mode mode);
+
+/** @brief Flush a persistent pool to stable storage.
+ *
+ * @param [in] allocator The allocator to be flushed.
+ *
+ * @return True on success.  Allocators which are not persistent have nothing
+ *         to flush and always succeed.
+ */
+bool op_ll_sync(const op_allocator allocator);
+
+/** @brief Make an independent copy of an allocator which shares its memory.
+ *
+ * @param [in, out] allocator The allocator to be cloned, which must have been
+ *                            configured `clonable`.
+ *
+ * @return An `op_allocator` handle or NULL on failure.
+ *
+ * The clone holds the same objects at the same slot indexes and handles, and
+ * either allocator may then be used, grown, compacted or deinitialized
+ * without affecting the other.  Both map every chunk copy-on-write, so
+ * cloning only costs page table updates and a page is only duplicated when
+ * one side writes it.  This makes cloning suitable for cheap checkpoints of
+ * large pools.  The original's objects keep their addresses; the clone's
+ * objects are at new ones, so references inside objects should be handles.
+ *
+ * @note 1. Cloning an allocator which has already been cloned, or which is a
+ *          clone, copies its chunks into new files first, since the pages
+ *          it has written since are private to it.
+ *       2. The clone has its own reserve, which is cloned too, and its own
+ *          copies of any objects spilled to `malloc()`.
+ *       3. The clone's chunks count in full against the memory budget even
+ *          while their pages are shared.
+ *       4. Allocators with a `constructor` or `destructor` cannot be cloned,
+ *          since constructed objects may own resources which a byte copy
+ *          would leave both allocators to release.  NULL is returned.
+ */
+op_allocator op_ll_clone(const op_allocator allocator);
+
+/** @brief Create a pool in shared memory for use by cooperating processes.
+ *
+ * @param [in] name        The name of a POSIX shared memory object, starting
+ *                         with '/', which must not exist yet; or NULL for an
+ *                         anonymous pool which is shared with child processes
+ *                         created by `fork()` after this call.
+ * @param [in] object_size The size of each object.
+ * @param [in] capacity    The number of objects the pool holds, less than
+ *                         `UINT32_MAX`.
+ *
+ * @return An `op_allocator` handle or NULL on failure.
+ *
+ * The pool's bookkeeping and objects all live in one segment, which is
+ * reserved in full when the pool is created and never grows.  Pages are only
+ * given memory as objects first use them.  Allocation, deallocation and the
+ * handle functions may be called from any thread of any process using the
+ * pool; the free list is lock-free, so a process which dies mid-operation
+ * cannot block the others.
+ *
+ * Each process maps the segment at an address of its own, so objects are
+ * passed between processes as handles from `op_ll_object_handle()`.  Since
+ * the capacity is below `UINT32_MAX`, handles of shared pools fit in a
+ * `uint32_t`.
+ *
+ * @note 1. Only allocation, deallocation, handles, statistics and
+ *          `op_ll_deinitialize_allocator()` apply to shared pools.  The pool
+ *          uses no configuration and its memory does not count against the
+ *          memory budget.
+ *       2. A named segment outlives the processes using it until it is
+ *          removed with `shm_unlink()`.
+ *       3. Objects are zeroed on allocation like those of any other pool.
+ */
+op_allocator op_ll_create_shared(const char *name, const size_t object_size, const size_t capacity);
+
+/** @brief Attach to a named pool created by `op_ll_create_shared()`.
+ *
+ * @param [in] name The name the pool was created with.
+ *
+ * @return An `op_allocator` handle or NULL on failure.
+ */
+op_allocator op_ll_attach_shared(const char *name);
+
 /** @brief De-initialize an allocator, freeing any owned resources.
  *
  * @param [in, out] allocator The allocator from which to free the object.
@@ -109,6 +725,16 @@ void op_ll_deinitialize_allocator(op_allocator allocator);
  */
 op_allocator_stats op_ll_get_allocator_stats(const op_allocator allocator);
 
+/** @brief Get the number of slots an allocator has.
+ *
+ * @param [in] allocator The allocator to check.
+ *
+ * @return `maximum_objects` from the allocator's stats, without gathering the
+ *         rest of them.  It only changes when the pool grows, so comparing it
+ *         before and after an operation is a cheap way to catch growth.
+ */
+size_t op_ll_capacity(const op_allocator allocator);
+
 /** @brief Initialize an allocator according to the provided configuration.
  *
  * @param [in] object_size   The size each individual object requires in RAM.
@@ -128,6 +754,211 @@ op_allocator_stats op_ll_get_allocator_stats(const op_allocator allocator);
 op_allocator op_ll_initialize_allocator(const size_t object_size, const size_t initial_count,
                                         const op_ll_allocator_mode mode);
 
+/** @brief Retrieve the configuration used by `op_ll_initialize_allocator()`.
+ *
+ * @return The default allocator configuration.
+ */
+op_allocator_config op_ll_default_allocator_config(void);
+
+/** @brief Initialize an allocator with a non-default configuration.
+ *
+ * @param [in] object_size   The size each individual object requires in RAM.
+ * @param [in] initial_count The starting size of the allocator's array.
+ * @param [in] mode          The growth and allocation mode of the allocator.
+ * @param [in] config        The configuration to use, or NULL for the defaults.
+ *
+ * @return An `op_allocator` handle used in subsequent operations or NULL on
+ *         failure.
+ *
+ * @note The placement policies behave as follows:
+ *       - `OP_PLACE_LOWEST_INDEX` reuses the lowest-index free slot, which is
+ *         the historic behaviour.
+ *       - `OP_PLACE_MOST_FULL` reuses a free slot of the fullest chunk which
+ *         still has room, so sparse chunks drain and can be freed by
+ *         `op_ll_compact()`.  Without chunk allocation it behaves as
+ *         `OP_PLACE_LOWEST_INDEX`.
+ *       - `OP_PLACE_LIFO` reuses the most recently freed slot, whose memory is
+ *         the most likely to still be in cache.  Allocation is O(1).
+ *       - `OP_PLACE_ADDRESS_ORDERED` reuses the free slot with the lowest
+ *         address.
+ *       In every policy, free slots whose memory was freed by `op_ll_compact()`
+ *       are only reused once no other free slot remains.
+ *
+ * @note With `cache_coloring`, each new chunk starts on a boundary of
+ *       `OP_CACHE_COLORS` cache lines and its first object is offset by a
+ *       further 0 to `OP_CACHE_COLORS - 1` cache lines, rotating from chunk
+ *       to chunk.  The same slot of different chunks then maps to different
+ *       cache sets, which matters for power-of-two object sizes.  Each chunk
+ *       costs up to `2 * OP_CACHE_COLORS * OP_CACHE_LINE_SIZE` more bytes.
+ *
+ * @note With `cache_line_padding`, every object starts on a cache line and
+ *       the distance between objects is rounded up to whole cache lines, so
+ *       objects mutated concurrently by different threads never share a
+ *       cache line.  The memory this costs is reported as `padding_bytes` in
+ *       the allocator's stats.
+ *
+ * @note With a `constructor`, objects are cached in their constructed state in
+ *       the manner of Bonwick's object caches.  The constructor runs once per
+ *       slot when the slot's memory is created, which for chunk allocation is
+ *       when the chunk is filled.  Allocation then no longer zeroes objects
+ *       and a deallocated object keeps whatever state it had, so an object
+ *       must be returned to its constructed state before it is deallocated.
+ *       The `destructor` runs only when the memory is finally freed, that is
+ *       when `op_ll_compact()` frees it or the allocator is de-initialized.
+ *
+ * @note With `deferred_zeroing`, zeroing moves off the allocation path:
+ *       deallocated objects are queued and zeroed by `op_ll_scrub()`, and
+ *       allocation takes the most recently zeroed free object ahead of the
+ *       placement policy.  Only when no zeroed object is free does allocation
+ *       fall back to the placement policy and zero the object itself, which
+ *       is counted as `inline_zeroings` in the allocator's stats.  It is
+ *       ignored for allocators with a constructor.
+ *
+ * @note With `bounded_latency`, allocation never calls into the system
+ *       allocator: it neither grows the pool nor restores memory released by
+ *       compaction, and individually allocated objects are all backed when
+ *       the allocator is initialized.  When the available objects drop below
+ *       `low_watermark` (or run out) growth is requested, and
+ *       `op_ll_maintain()` carries it out.  Periodic free list sorting and
+ *       decay checks, which allocate and free, are also left to
+ *       `op_ll_maintain()`.  An allocation finding no available object fails
+ *       with NULL and is counted as `exhausted_allocations` in the
+ *       allocator's stats.
+ *
+ * @note With `max_objects` or `max_bytes`, the pool never grows past that
+ *       many objects, or past that many bytes of slots, and the initial
+ *       count is clipped to match.  Limits without room for one object fail
+ *       initialization, whatever `overflow` says.  Per-chunk overhead such as
+ *       cache coloring is not counted.  Allocation at the limits is counted as
+ *       `capped_allocations` in the allocator's stats and follows `overflow`:
+ *       - `OP_OVERFLOW_FAIL` fails with NULL.
+ *       - `OP_OVERFLOW_RESERVE` takes objects from an emergency reserve of
+ *         `reserve_count` objects, filled when the allocator is initialized
+ *         and never grown, and fails with NULL once it is used up.
+ *       - `OP_OVERFLOW_MALLOC` takes objects from malloc, reported as
+ *         `spilled_objects` and `spilled_bytes`.
+ *       Overflow objects are deallocated as usual, but they cannot be pinned
+ *       and are not moved by `op_ll_compact()`.
+ *
+ * @note With `advise_release`, chunks are mapped in whole pages, and where
+ *       `op_ll_compact()`, `op_ll_decay()` or a trim would free an empty
+ *       chunk, its pages are handed back to the kernel with
+ *       `madvise(MADV_FREE)` (`MADV_DONTNEED` where that is unavailable)
+ *       instead.  The chunk keeps its address and slots, so reusing it needs
+ *       no system call.  The destructor runs on every object of the chunk when
+ *       its pages are handed back and the constructor runs again when the
+ *       chunk is next used.  Handed-back bytes are subtracted from
+ *       `resident_bytes` in the allocator's stats and from the memory budget.
+ *       It is ignored without chunk allocation or where `madvise()` is
+ *       unavailable.
+ *
+ * @note With `init_threads` above 1, chunks of at least two
+ *       `OP_PARALLEL_INIT_SLICE` (4 MiB) slices are initialized by up to that
+ *       many threads, each of which zeroes its share of the chunk, faulting
+ *       its pages in, and runs the constructor on its objects.  This speeds
+ *       up initializing allocators with a very large `initial_count`, and
+ *       growing them.  The constructor then runs concurrently and must be
+ *       thread-safe, including any use of `hook_context`.  It is ignored
+ *       where POSIX threads are unavailable.
+ *
+ * @note With `clonable`, every chunk is mapped from an anonymous file of its
+ *       own (a memfd where available) so that `op_ll_clone()` can share its
+ *       pages.  It is ignored without chunk allocation or where `mmap()` is
+ *       unavailable, and turns `advise_release` off.
+ *
+ * @note With `io_buffers`, the pool holds buffers for `readv()`,
+ *       `writev()`, `O_DIRECT` and the like.  The slot stride is rounded up
+ *       to a multiple of the page size and every slot starts on a page
+ *       boundary, with nothing but the buffer in its pages.  Chunks are
+ *       mapped in whole pages and never freed or moved before the allocator
+ *       is deinitialized, so their addresses can be registered with the
+ *       kernel once, for example as io_uring fixed buffers; empty chunks
+ *       only have their pages handed back if `advise_release` is also set,
+ *       which keeps them mapped.  Cache coloring is turned off.  Combine with
+ *       `deferred_zeroing` to take zeroing buffers off the allocation path.
+ */
+op_allocator op_ll_initialize_configured_allocator(const size_t object_size, const size_t initial_count,
+                                                   const op_ll_allocator_mode mode, const op_allocator_config *config);
+
+/** @brief Events recorded by allocation tracing. */
+typedef enum op_trace_event
+{
+    OP_TRACE_ALLOCATE,      /**< an object was allocated; the slot is its index    */
+    OP_TRACE_DEALLOCATE,    /**< an object was freed; the slot is its index        */
+    OP_TRACE_GROW,          /**< the pool grew; the slot is its new object count   */
+} op_trace_event;
+
+/** @brief One record of a trace file. */
+typedef struct op_trace_record
+{
+    uint64_t timestamp;     /**< trace clock ticks, see `op_trace_header`                        */
+    uint32_t allocator;     /**< allocator id, numbered from 1 in the order allocators are first traced */
+    uint32_t slot;          /**< slot index, or `UINT32_MAX` for objects from outside the pool  */
+    uint32_t thread;        /**< thread id, numbered from 1 in the order threads are first traced */
+    uint32_t event;         /**< an `op_trace_event`                                             */
+} op_trace_record;
+
+/** @brief The header at the start of a trace file, followed by its records. */
+typedef struct op_trace_header
+{
+    char     magic[8];      /**< "OPTRACE"                                       */
+    uint32_t version;
+    uint32_t record_size;   /**< `sizeof(op_trace_record)`                       */
+    uint64_t start_ns;      /**< `CLOCK_MONOTONIC` when tracing started          */
+    uint64_t start_ticks;   /**< the trace clock at the same moment              */
+    uint64_t stop_ns;       /**< `CLOCK_MONOTONIC` when tracing stopped          */
+    uint64_t stop_ticks;    /**< the trace clock at the same moment              */
+    uint64_t records;       /**< records written to the file                     */
+    uint64_t dropped;       /**< records lost because a ring buffer was full     */
+} op_trace_header;
+
+/** @brief Start recording allocator activity to a trace file.
+ *
+ * @param [in] path The file to write, which is created or truncated.
+ *
+ * @return True if tracing started, false on failure or if tracing is not
+ *         compiled in.
+ *
+ * Tracing is compiled in by defining `OP_TRACE` to 1 when building the
+ * library (`make USE_TRACE=true`).  While it runs, every allocation,
+ * deallocation and pool growth of every allocator appends a record to a ring
+ * buffer of `OP_TRACE_RING_RECORDS` records belonging to the calling thread.
+ * No locks are taken: a thread whose ring is full writes it to the file
+ * itself, and drops the record if `op_ll_trace_flush()` is writing it at the
+ * time.
+ *
+ * Recording costs a read of the clock and a 24-byte store; with tracing
+ * compiled in but not running, a load and a branch.  The clock read
+ * dominates, so where it is slow, as on virtual machines which trap the time
+ * stamp counter, a running trace can add more than 10% to a loop which does
+ * nothing but allocate and free.
+ *
+ * Timestamps are in ticks of the cheapest monotonic clock available, the
+ * time stamp counter on x86, and are converted to nanoseconds with the two
+ * pairs of readings in the header.  Records are written a ring at a time, so
+ * the file is ordered per thread only; sort by timestamp to interleave the
+ * threads.
+ *
+ * @note 1. Only one trace runs at a time.
+ *       2. Ring buffers live until the process exits, so that threads can
+ *          keep recording without checking whether theirs has gone.
+ *       3. Records made while the trace is stopping may be lost.
+ */
+bool op_ll_trace_start(const char *path);
+
+/** @brief Write the records buffered by every thread to the trace file.
+ *
+ * Call this periodically, from any thread, to keep the rings from filling.
+ */
+void op_ll_trace_flush(void);
+
+/** @brief Stop tracing, write the remaining records and close the file.
+ *
+ * @return True if every record reached the file, false otherwise or if no
+ *         trace was running.
+ */
+bool op_ll_trace_stop(void);
+
 /**@}*/
 
 /** @defgroup hlinterface High-level (Macro) interface
@@ -174,10 +1005,35 @@ op_allocator op_ll_initialize_allocator(const size_t object_size, const size_t i
  *
  */
 #define OP_HL_DECLARE_ALLOCATOR(TYPE, COUNT, MODE)                            \
+        OP_HL_DECLARE_CONFIGURED_ALLOCATOR(TYPE, COUNT, MODE, (void) 0)
+
+/** @brief Declare a component allocator whose objects never share cache lines.
+ *
+ * Use this for objects mutated concurrently by different threads, such as
+ * per-connection counters, to avoid false sharing.
+ */
+#define OP_HL_DECLARE_PADDED_ALLOCATOR(TYPE, COUNT, MODE)                     \
+        OP_HL_DECLARE_CONFIGURED_ALLOCATOR(TYPE, COUNT, MODE,                 \
+                                           config.cache_line_padding = true)
+
+/** @brief Declare a component allocator with a non-default configuration.
+ *
+ * The trailing arguments are statements which adjust an `op_allocator_config`
+ * named `config`, already holding the defaults, before the allocator is
+ * initialized.  For example:
+ *
+ *     OP_HL_DECLARE_CONFIGURED_ALLOCATOR(my_fancy_type, 4, OP_DOUBLING_CHUNK,
+ *                                        config.placement = OP_PLACE_LIFO);
+ */
+#define OP_HL_DECLARE_CONFIGURED_ALLOCATOR(TYPE, COUNT, MODE, ...)            \
 static op_allocator TYPE##_allocator;                                         \
 static bool TYPE##_allocator_initialized = false;                             \
 static inline void initialize_##TYPE##_allocator(void)                        \
-{ TYPE##_allocator = op_ll_initialize_allocator(sizeof(TYPE), COUNT, MODE); } \
+{ op_allocator_config config = op_ll_default_allocator_config();              \
+  __VA_ARGS__;                                                                \
+  TYPE##_allocator = op_ll_initialize_configured_allocator(sizeof(TYPE),      \
+                                                           COUNT, MODE,       \
+                                                           &config); }        \
 static inline TYPE *allocate_##TYPE(void)                                     \
 { if (!TYPE##_allocator_initialized)                                          \
   { initialize_##TYPE##_allocator(); TYPE##_allocator_initialized = true; }   \
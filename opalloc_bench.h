@@ -0,0 +1,36 @@
+/* vim: ft=c */
+#ifndef OPALLOC_BENCH_INCLUDED
+#define OPALLOC_BENCH_INCLUDED
+/******************************************************************************
+* (c)2022 Michael T. Richter
+*
+* This software is distributed under the terms of WTFPLv2.  The full terms and
+* text of the license can be found at http://www.wtfpl.net/txt/copying
+******************************************************************************/
+/*
+ * Timing and random numbers shared by the benchmarks.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+/* the seed every benchmark starts from, so that every run makes the same choices */
+#define BENCH_RANDOM_SEED 0x9e3779b97f4a7c15u
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/* xorshift64, which is cheap enough not to show up in the timings */
+static inline uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+#endif
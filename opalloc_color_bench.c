@@ -0,0 +1,99 @@
+/******************************************************************************
+* (c)2022 Michael T. Richter
+*
+* This software is distributed under the terms of WTFPLv2.  The full terms and
+* text of the license can be found at http://www.wtfpl.net/txt/copying
+******************************************************************************/
+#include "opalloc.h"
+#include "opalloc_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+/*
+ * Cache coloring benchmark.
+ *
+ * Every chunk of a linear chunk allocator holds CHUNK_BYTES worth of power-of-two
+ * sized objects.  Chunks that large are page-mapped by the C library, so every
+ * chunk starts at the same alignment and the first object of every chunk lands
+ * in the same cache sets.  The benchmark links the first objects of all chunks
+ * into a ring and chases it, with and without cache coloring, reporting the
+ * average latency per hop.  Each hop depends on the previous one, so cache
+ * misses caused by set conflicts cannot be overlapped.
+ *
+ * Results are written to stdout as JSON, e.g. `./bin/opacolor > color.json`.
+ */
+
+#define CHUNK_BYTES       (256 * 1024)
+#define CHUNKS            32
+#define ROUNDS            50000
+
+static double touch_hot_objects(const size_t object_size, const bool coloring)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.cache_coloring = coloring;
+    config.placement = OP_PLACE_LIFO;
+    size_t objects_per_chunk = CHUNK_BYTES / object_size;
+    op_allocator allocator = op_ll_initialize_configured_allocator(object_size, objects_per_chunk, OP_LINEAR_CHUNK,
+                             &config);
+
+    /* with nothing freed yet the free list hands out slots in order, so every objects_per_chunk-th object is a chunk's
+     * first */
+    void **hot[CHUNKS];
+    for (size_t i = 0; i < CHUNKS * objects_per_chunk; i++)
+    {
+        void *object = op_ll_allocate_object(allocator);
+        if (i % objects_per_chunk == 0)
+        {
+            hot[i / objects_per_chunk] = object;
+        }
+    }
+    for (size_t c = 0; c < CHUNKS; c++)
+    {
+        *hot[c] = hot[(c + 1) % CHUNKS];
+    }
+
+    void **cursor = hot[0];
+    for (size_t hop = 0; hop < CHUNKS; hop++)
+    {
+        cursor = *cursor;   /* warm the cache */
+    }
+    uint64_t start = now_ns();
+    for (size_t hop = 0; hop < (size_t) ROUNDS * CHUNKS; hop++)
+    {
+        cursor = *cursor;
+    }
+    double elapsed = now_ns() - start;
+    if (cursor == NULL)
+    {
+        fprintf(stderr, "broken ring\n");
+    }
+
+    op_ll_deinitialize_allocator(allocator);
+    return elapsed / ((double) ROUNDS * CHUNKS);
+}
+
+int main(void)
+{
+#if defined(__GLIBC__)
+    /* pin the threshold, otherwise freeing the first allocator's chunks raises it and later chunks come from the heap */
+    mallopt(M_MMAP_THRESHOLD, CHUNK_BYTES / 2);
+#endif
+    fprintf(stdout, "{\n  \"benchmark\": \"cache coloring\",\n  \"chunk_bytes\": %d,\n  \"chunks\": %d,\n"
+            "  \"rounds\": %d,\n  \"results\": [", CHUNK_BYTES, CHUNKS, ROUNDS);
+    const char *separator = "\n";
+    for (size_t object_size = 64; object_size <= 8192; object_size <<= 1)
+    {
+        double plain = touch_hot_objects(object_size, false);
+        double colored = touch_hot_objects(object_size, true);
+        fprintf(stdout, "%s    { \"object_size\": %zu, \"plain_ns\": %.2f, \"colored_ns\": %.2f, \"speedup\": %.3f }",
+                separator, object_size, plain, colored, plain / colored);
+        separator = ",\n";
+        fflush(stdout);
+    }
+    fprintf(stdout, "\n  ]\n}\n");
+    return 0;
+}
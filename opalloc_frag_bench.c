@@ -0,0 +1,405 @@
+/******************************************************************************
+* (c)2022 Michael T. Richter
+*
+* This software is distributed under the terms of WTFPLv2.  The full terms and
+* text of the license can be found at http://www.wtfpl.net/txt/copying
+******************************************************************************/
+#include "opalloc.h"
+#include "opalloc_bench.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Fragmentation simulator.
+ *
+ * Replays four simulated hours of interlaced allocations and deallocations of
+ * five object types, once against one opalloc pool per type and once against
+ * malloc(), each in a process of its own so that their resident set sizes can
+ * be compared.  A tick is one simulated second.  Every hour is a phase with
+ * its own allocation rate and mix of types: small objects, then large ones,
+ * then a burst of everything, then a quiet hour in which the live set shrinks
+ * and an allocator should give memory back.  Lifetimes follow a Pareto
+ * distribution, so most objects die within minutes while a few live for
+ * hours, pinning whatever memory they sit in.
+ *
+ * Every SAMPLE_TICKS the simulator records the bytes of live objects, the
+ * resident set (less what the process held before the run), the memory the
+ * allocator holds, how much of that is free, and the largest free block: the
+ * longest run of free slots in any chunk for opalloc, and the largest gap
+ * between live blocks in the heap for malloc().  The opalloc pools use the
+ * most-full placement policy and are compacted, without relocation, at every
+ * sample.  The simulator's own bookkeeping is mapped and touched before the
+ * run so that it never mixes with the objects in the heap.
+ *
+ * The samples and a summary per allocator are written to stdout as JSON, e.g.
+ * `./bin/opafrag > fragmentation.json`.  Resident set sizes come from /proc,
+ * so the simulator needs Linux.
+ */
+
+#define PHASE_TICKS   3600
+#define PHASES        4
+#define TICKS         (PHASE_TICKS * PHASES)
+#define SAMPLE_TICKS  300
+#define SAMPLES       (TICKS / SAMPLE_TICKS + 1)
+#define TYPES         5
+#define MAX_LIFETIME  8191                  /* ticks; also the size of the timing wheel less one */
+#define MAX_LIVE      (1 << 20)
+#define CHUNK_OBJECTS 1024
+
+typedef struct phase
+{
+    size_t rate;                /* allocations per tick */
+    unsigned weights[TYPES];
+} phase;
+
+typedef struct record
+{
+    void *object;
+    uint32_t type;
+    uint32_t next;              /* next record dying at the same tick, or free */
+} record;
+
+typedef struct sample
+{
+    uint64_t tick;
+    uint64_t live_objects;
+    uint64_t live_bytes;
+    uint64_t rss_bytes;
+    uint64_t held_bytes;
+    uint64_t free_bytes;
+    uint64_t largest_free_block;
+} sample;
+
+typedef struct block
+{
+    uintptr_t start;
+    uintptr_t end;
+} block;
+
+static const size_t type_sizes[TYPES] = { 24, 96, 320, 1200, 4000 };
+
+static const phase phases[PHASES] =
+{
+    { 60,  { 60, 25, 10,  4,  1 } },   /* small objects */
+    { 40,  { 10, 10, 20, 30, 30 } },   /* large objects */
+    { 120, { 30, 30, 20, 15,  5 } },   /* burst of everything */
+    { 10,  { 60, 25, 10,  4,  1 } },   /* quiet; the live set shrinks */
+};
+
+#define NO_RECORD UINT32_MAX
+
+#if defined(__linux__) && OP_HAVE_IOVEC
+
+static uint64_t random_state = BENCH_RANDOM_SEED;
+
+static double uniform(void)
+{
+    return ((next_random(&random_state) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static size_t pick_lifetime(void)
+{
+    /* Pareto with a minimum of 20 ticks and shape 1.1: a mean of a few minutes and a tail of hours */
+    double lifetime = 20.0 / pow(uniform(), 1.0 / 1.1);
+    return lifetime < MAX_LIFETIME ? (size_t) lifetime : MAX_LIFETIME;
+}
+
+/* scratch memory that never comes from the heap under test */
+static void *map_scratch(const size_t bytes)
+{
+    void *rv = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return rv == MAP_FAILED ? NULL : rv;
+}
+
+static uint64_t resident_bytes(void)
+{
+    unsigned long size = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm)
+    {
+        if (fscanf(statm, "%lu %lu", &size, &resident) != 2) { resident = 0; }
+        fclose(statm);
+    }
+    return (uint64_t) resident * (uint64_t) sysconf(_SC_PAGESIZE);
+}
+
+static int compare_blocks(const void *a, const void *b)
+{
+    const block *x = a, *y = b;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+/* the memory an allocator holds and the free part of it, for one sample */
+typedef void (*measure_func)(op_allocator *pools, const record *records, uint32_t *wheel, sample *s);
+
+static void measure_pools(op_allocator *pools, const record *records, uint32_t *wheel, sample *s)
+{
+    for (size_t t = 0; t < TYPES; t++)
+    {
+        op_allocator_stats stats = op_ll_get_allocator_stats(pools[t]);
+        s->held_bytes += stats.resident_bytes;
+        s->free_bytes += stats.available_objects * stats.slot_stride;
+
+        /* mark the slots of live objects, then find the longest unmarked run in any chunk */
+        size_t regions_count = op_ll_chunk_regions(pools[t], NULL, 0);
+        struct iovec *regions = map_scratch((regions_count + 1) * sizeof(struct iovec));
+        uint8_t *used = map_scratch(stats.maximum_objects + 1);
+        size_t *first = map_scratch((regions_count + 1) * sizeof(size_t));
+        op_ll_chunk_regions(pools[t], regions, regions_count);
+        for (size_t c = 0, slots = 0; c < regions_count; c++)
+        {
+            first[c] = slots;
+            slots += regions[c].iov_len / stats.slot_stride;
+        }
+        for (size_t tick = 0; tick <= MAX_LIFETIME; tick++)
+        {
+            for (uint32_t r = wheel[tick]; r != NO_RECORD; r = records[r].next)
+            {
+                if (records[r].type == t)
+                {
+                    size_t c = op_ll_object_region(pools[t], records[r].object);
+                    used[first[c] + ((uint8_t *) records[r].object - (uint8_t *) regions[c].iov_base) / stats.slot_stride] = 1;
+                }
+            }
+        }
+        for (size_t c = 0; c < regions_count; c++)
+        {
+            size_t run = 0;
+            for (size_t i = 0; i < regions[c].iov_len / stats.slot_stride; i++)
+            {
+                run = used[first[c] + i] ? 0 : run + 1;
+                if (run * stats.slot_stride > s->largest_free_block)
+                {
+                    s->largest_free_block = run * stats.slot_stride;
+                }
+            }
+        }
+        munmap(first, (regions_count + 1) * sizeof(size_t));
+        munmap(used, stats.maximum_objects + 1);
+        munmap(regions, (regions_count + 1) * sizeof(struct iovec));
+    }
+}
+
+static void measure_heap(op_allocator *pools, const record *records, uint32_t *wheel, sample *s)
+{
+    (void) pools;
+#if defined(__GLIBC__)
+    struct mallinfo2 info = mallinfo2();
+    s->held_bytes = info.arena + info.hblkhd;
+    s->free_bytes = info.fordblks;
+#endif
+
+    /* the largest gap between neighbouring live blocks, less the header of the block after it */
+    block *blocks = map_scratch((s->live_objects + 1) * sizeof(block));
+    size_t count = 0;
+    for (size_t tick = 0; tick <= MAX_LIFETIME; tick++)
+    {
+        for (uint32_t r = wheel[tick]; r != NO_RECORD; r = records[r].next)
+        {
+            uintptr_t start = (uintptr_t) records[r].object;
+            blocks[count++] = (block) { start, start + malloc_usable_size(records[r].object) };
+        }
+    }
+    qsort(blocks, count, sizeof(block), compare_blocks);
+    for (size_t b = 1; b < count; b++)
+    {
+        uintptr_t gap = blocks[b].start - blocks[b - 1].end;
+        if (gap > 2 * sizeof(size_t) && gap - 2 * sizeof(size_t) > s->largest_free_block
+                && gap < ((uintptr_t) 1 << 26))     /* larger gaps are between separate mappings */
+        {
+            s->largest_free_block = gap - 2 * sizeof(size_t);
+        }
+    }
+    munmap(blocks, (s->live_objects + 1) * sizeof(block));
+}
+
+static void simulate(const bool use_malloc, sample *samples)
+{
+    /* all bookkeeping is mapped and touched up front, so that it is part of the baseline */
+    record *records = map_scratch(MAX_LIVE * sizeof(record));
+    uint32_t *wheel = map_scratch((MAX_LIFETIME + 1) * sizeof(uint32_t));
+    memset(records, 0, MAX_LIVE * sizeof(record));
+    uint32_t free_records = 0;
+    for (uint32_t r = 0; r < MAX_LIVE; r++)
+    {
+        records[r].next = r + 1 < MAX_LIVE ? r + 1 : NO_RECORD;
+    }
+    for (size_t tick = 0; tick <= MAX_LIFETIME; tick++)
+    {
+        wheel[tick] = NO_RECORD;
+    }
+
+    op_allocator pools[TYPES] = { NULL };
+    for (size_t t = 0; !use_malloc && t < TYPES; t++)
+    {
+        op_allocator_config config = op_ll_default_allocator_config();
+        config.placement = OP_PLACE_MOST_FULL;
+        pools[t] = op_ll_initialize_configured_allocator(type_sizes[t], CHUNK_OBJECTS, OP_LINEAR_CHUNK, &config);
+    }
+    uint64_t baseline = resident_bytes(), live_objects = 0, live_bytes = 0;
+
+    for (size_t tick = 0; tick <= TICKS; tick++)
+    {
+        /* the dead go first */
+        size_t slot = tick % (MAX_LIFETIME + 1);
+        for (uint32_t r = wheel[slot], next; r != NO_RECORD; r = next)
+        {
+            next = records[r].next;
+            if (use_malloc) { free(records[r].object); }
+            else            { op_ll_deallocate_object(pools[records[r].type], records[r].object); }
+            live_objects--;
+            live_bytes -= type_sizes[records[r].type];
+            records[r].next = free_records;
+            free_records = r;
+        }
+        wheel[slot] = NO_RECORD;
+
+        const phase *p = &phases[tick / PHASE_TICKS < PHASES ? tick / PHASE_TICKS : PHASES - 1];
+        unsigned total_weight = 0;
+        for (size_t t = 0; t < TYPES; t++)
+        {
+            total_weight += p->weights[t];
+        }
+        for (size_t a = 0; a < p->rate && free_records != NO_RECORD; a++)
+        {
+            unsigned pick = (unsigned) (next_random(&random_state) % total_weight);
+            uint32_t type = 0;
+            while (pick >= p->weights[type])
+            {
+                pick -= p->weights[type++];
+            }
+            void *object = use_malloc ? malloc(type_sizes[type]) : op_ll_allocate_object(pools[type]);
+            memset(object, 0xa5, type_sizes[type]);
+
+            uint32_t r = free_records;
+            free_records = records[r].next;
+            size_t death = (tick + pick_lifetime()) % (MAX_LIFETIME + 1);
+            records[r] = (record) { .object = object, .type = type, .next = wheel[death] };
+            wheel[death] = r;
+            live_objects++;
+            live_bytes += type_sizes[type];
+        }
+
+        if (tick % SAMPLE_TICKS == 0)
+        {
+            for (size_t t = 0; !use_malloc && t < TYPES; t++)
+            {
+                op_ll_compact(pools[t], NULL, NULL);
+            }
+            sample *s = &samples[tick / SAMPLE_TICKS];
+            *s = (sample) { .tick = tick, .live_objects = live_objects, .live_bytes = live_bytes };
+            uint64_t resident = resident_bytes();
+            s->rss_bytes = resident > baseline ? resident - baseline : 0;
+            measure_func measure = use_malloc ? measure_heap : measure_pools;
+            measure(pools, records, wheel, s);
+        }
+    }
+}
+
+static bool run(const bool use_malloc, sample *samples)
+{
+    /* a process of its own keeps each allocator's resident set apart from the other's */
+    bool rv = false;
+    int channel[2];
+    if (pipe(channel) == 0)
+    {
+        pid_t child = fork();
+        if (child == 0)
+        {
+            close(channel[0]);
+            sample *mine = map_scratch(SAMPLES * sizeof(sample));
+            simulate(use_malloc, mine);
+            _exit(write(channel[1], mine, SAMPLES * sizeof(sample)) == SAMPLES * sizeof(sample) ? 0 : 1);
+        }
+        close(channel[1]);
+        size_t got = 0;
+        ssize_t n;
+        while (child > 0 && got < SAMPLES * sizeof(sample)
+                && (n = read(channel[0], (uint8_t *) samples + got, SAMPLES * sizeof(sample) - got)) > 0)
+        {
+            got += (size_t) n;
+        }
+        close(channel[0]);
+        int status = 0;
+        rv = child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0
+             && got == SAMPLES * sizeof(sample);
+    }
+    return rv;
+}
+
+static void report(const char *name, const sample *samples, const char *separator)
+{
+    uint64_t peak_rss = 0, peak_largest = 0;
+    double rss_sum = 0, overhead_sum = 0, free_share_sum = 0;
+    size_t overhead_samples = 0;
+    for (size_t i = 0; i < SAMPLES; i++)
+    {
+        const sample *s = &samples[i];
+        peak_rss = s->rss_bytes > peak_rss ? s->rss_bytes : peak_rss;
+        peak_largest = s->largest_free_block > peak_largest ? s->largest_free_block : peak_largest;
+        rss_sum += s->rss_bytes;
+        if (s->live_bytes > 0)
+        {
+            overhead_sum += (double) s->rss_bytes / s->live_bytes;
+            free_share_sum += s->held_bytes ? (double) s->free_bytes / s->held_bytes : 0;
+            overhead_samples++;
+        }
+    }
+
+    fprintf(stdout, "    \"%s\": {\n      \"summary\": { \"peak_rss_bytes\": %llu, \"mean_rss_bytes\": %.0f, "
+            "\"final_rss_bytes\": %llu, \"final_live_bytes\": %llu, \"mean_rss_per_live_byte\": %.3f, "
+            "\"mean_free_share_of_held\": %.3f, \"peak_largest_free_block\": %llu },\n      \"samples\": [",
+            name, (unsigned long long) peak_rss, rss_sum / SAMPLES, (unsigned long long) samples[SAMPLES - 1].rss_bytes,
+            (unsigned long long) samples[SAMPLES - 1].live_bytes, overhead_sum / overhead_samples,
+            free_share_sum / overhead_samples, (unsigned long long) peak_largest);
+    for (size_t i = 0; i < SAMPLES; i++)
+    {
+        const sample *s = &samples[i];
+        fprintf(stdout, "%s\n        { \"tick\": %llu, \"live_objects\": %llu, \"live_bytes\": %llu, "
+                "\"rss_bytes\": %llu, \"held_bytes\": %llu, \"free_bytes\": %llu, \"largest_free_block\": %llu }",
+                i ? "," : "", (unsigned long long) s->tick, (unsigned long long) s->live_objects,
+                (unsigned long long) s->live_bytes, (unsigned long long) s->rss_bytes,
+                (unsigned long long) s->held_bytes, (unsigned long long) s->free_bytes,
+                (unsigned long long) s->largest_free_block);
+    }
+    fprintf(stdout, "\n      ]\n    }%s\n", separator);
+}
+
+int main(void)
+{
+    sample *pooled = calloc(SAMPLES, sizeof(sample)), *heap = calloc(SAMPLES, sizeof(sample));
+    if (!run(false, pooled) || !run(true, heap))
+    {
+        fprintf(stderr, "simulation failed\n");
+        return 1;
+    }
+
+    fprintf(stdout, "{\n  \"benchmark\": \"fragmentation\",\n  \"ticks\": %d,\n  \"sample_ticks\": %d,\n"
+            "  \"results\": {\n", TICKS, SAMPLE_TICKS);
+    report("opalloc", pooled, ",");
+    report("malloc", heap, "");
+    fprintf(stdout, "  }\n}\n");
+
+    free(heap);
+    free(pooled);
+    return 0;
+}
+
+#else
+
+int main(void)
+{
+    fprintf(stderr, "The fragmentation simulator needs Linux.\n");
+    return 0;
+}
+
+#endif
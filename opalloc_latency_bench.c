@@ -0,0 +1,281 @@
+/******************************************************************************
+* (c)2022 Michael T. Richter
+*
+* This software is distributed under the terms of WTFPLv2.  The full terms and
+* text of the license can be found at http://www.wtfpl.net/txt/copying
+******************************************************************************/
+#include "opalloc.h"
+#include "opalloc_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Tail latency benchmark.
+ *
+ * Averages hide the stalls of growing a pool: reallocating the slot index and
+ * allocating a new chunk (or, with individual allocation, a new object) all
+ * happen inside the allocation that found the pool full.  This benchmark times
+ * every single operation and records it in a log-linear histogram, in the
+ * manner of HdrHistogram, so that the median and the far tail are both
+ * reported with about 3% precision.
+ *
+ * Every subject first fills a pool of POOL_OBJECTS objects from a small
+ * initial allocation, then churns it by freeing a random live object and
+ * allocating a new one CHURN_OPERATIONS times.  Allocations which grew the
+ * pool are recorded apart from the others, and the slowest of them are listed
+ * with the capacity before and after, so that every spike can be traced to
+ * the growth step which caused it.  Allocators with `bounded_latency` grow
+ * only in `op_ll_maintain()`, which is called between operations whenever
+ * growth is pending and timed on its own.
+ *
+ * All pools use LIFO placement, the constant-time policy.  Results are written
+ * to stdout as JSON, e.g. `./bin/opalatency > latency.json`.
+ */
+
+#define POOL_OBJECTS     50000
+#define CHURN_OPERATIONS 50000
+#define INITIAL_COUNT    1024
+#define OBJECT_SIZE      64
+#define SLOWEST_GROWTHS  10
+
+/* 16 sub-buckets per power of two past the first 32 nanoseconds, about 3% precision */
+#define SUB_BUCKETS      16
+#define BUCKETS          (2 * SUB_BUCKETS + 60 * SUB_BUCKETS)
+
+typedef struct histogram
+{
+    uint64_t counts[BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} histogram;
+
+typedef struct growth_event
+{
+    uint64_t operation;
+    uint64_t ns;
+    size_t capacity_before;
+    size_t capacity_after;
+} growth_event;
+
+typedef struct subject
+{
+    const char *name;
+    bool use_malloc;
+    op_ll_allocator_mode mode;
+    bool bounded;
+} subject;
+
+typedef struct measurement
+{
+    histogram allocations;      /* allocations which did not grow the pool */
+    histogram growths;          /* allocations which did */
+    histogram deallocations;
+    histogram maintenance;
+    growth_event slowest[SLOWEST_GROWTHS];
+    size_t slowest_count;
+    size_t failures;
+} measurement;
+
+static const subject subjects[] =
+{
+    { "malloc",              true,  OP_DOUBLING_INDIVIDUAL, false },
+    { "doubling_individual", false, OP_DOUBLING_INDIVIDUAL, false },
+    { "doubling_chunk",      false, OP_DOUBLING_CHUNK,      false },
+    { "linear_individual",   false, OP_LINEAR_INDIVIDUAL,   false },
+    { "linear_chunk",        false, OP_LINEAR_CHUNK,        false },
+    { "doubling_chunk",      false, OP_DOUBLING_CHUNK,      true  },
+    { "linear_chunk",        false, OP_LINEAR_CHUNK,        true  },
+};
+
+static size_t bucket_of(const uint64_t value)
+{
+    if (value < 2 * SUB_BUCKETS)
+    {
+        return (size_t) value;  /* exact below 32 */
+    }
+    size_t shift = 63 - (size_t) __builtin_clzll(value) - 4;  /* leaves value >> shift in [16, 32) */
+    return 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + (size_t) (value >> shift) - SUB_BUCKETS;
+}
+
+static uint64_t highest_in_bucket(const size_t bucket)
+{
+    if (bucket < 2 * SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    size_t shift = (bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+    uint64_t sub = (bucket - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+static void record(histogram *h, const uint64_t value)
+{
+    h->counts[bucket_of(value)]++;
+    h->total++;
+    h->max = value > h->max ? value : h->max;
+}
+
+static uint64_t percentile(const histogram *h, const double p)
+{
+    uint64_t rank = (uint64_t) (p / 100.0 * h->total + 0.5), seen = 0;
+    for (size_t b = 0; b < BUCKETS && h->total > 0; b++)
+    {
+        seen += h->counts[b];
+        if (seen >= rank && seen > 0)
+        {
+            uint64_t highest = highest_in_bucket(b);
+            return highest < h->max ? highest : h->max;
+        }
+    }
+    return 0;
+}
+
+static void note_growth(measurement *m, const growth_event event)
+{
+    /* keep the slowest growths, slowest first */
+    size_t at = m->slowest_count < SLOWEST_GROWTHS ? m->slowest_count++ : SLOWEST_GROWTHS;
+    while (at > 0 && m->slowest[at - 1].ns < event.ns)
+    {
+        if (at < SLOWEST_GROWTHS) { m->slowest[at] = m->slowest[at - 1]; }
+        at--;
+    }
+    if (at < SLOWEST_GROWTHS) { m->slowest[at] = event; }
+}
+
+static void maintain(op_allocator allocator, measurement *m)
+{
+    if (allocator && op_ll_growth_pending(allocator))
+    {
+        uint64_t start = now_ns();
+        op_ll_maintain(allocator);
+        record(&m->maintenance, now_ns() - start);
+    }
+}
+
+static void *allocate(const subject *s, op_allocator allocator, measurement *m, const uint64_t operation)
+{
+    size_t before = allocator ? op_ll_capacity(allocator) : 0;
+    uint64_t start = now_ns();
+    void *rv = s->use_malloc ? malloc(OBJECT_SIZE) : op_ll_allocate_object(allocator);
+    uint64_t elapsed = now_ns() - start;
+    size_t after = allocator ? op_ll_capacity(allocator) : 0;
+
+    if (rv == NULL)
+    {
+        m->failures++;
+    }
+    else if (after != before)
+    {
+        record(&m->growths, elapsed);
+        note_growth(m, (growth_event) { operation, elapsed, before, after });
+    }
+    else
+    {
+        record(&m->allocations, elapsed);
+    }
+    maintain(allocator, m);
+    return rv;
+}
+
+static void deallocate(const subject *s, op_allocator allocator, measurement *m, void *object)
+{
+    uint64_t start = now_ns();
+    if (s->use_malloc) { free(object); }
+    else               { op_ll_deallocate_object(allocator, object); }
+    record(&m->deallocations, now_ns() - start);
+    maintain(allocator, m);
+}
+
+static void run(const subject *s, measurement *m)
+{
+    op_allocator allocator = NULL;
+    if (!s->use_malloc)
+    {
+        op_allocator_config config = op_ll_default_allocator_config();
+        config.placement = OP_PLACE_LIFO;
+        config.bounded_latency = s->bounded;
+        config.low_watermark = s->bounded ? INITIAL_COUNT / 4 : 0;
+        config.high_watermark = s->bounded ? INITIAL_COUNT : 0;
+        allocator = op_ll_initialize_configured_allocator(OBJECT_SIZE, INITIAL_COUNT, s->mode, &config);
+    }
+    void **live = calloc(POOL_OBJECTS, sizeof(void *));
+    uint64_t state = BENCH_RANDOM_SEED, operation = 0;
+
+    for (size_t i = 0; i < POOL_OBJECTS; i++)
+    {
+        live[i] = allocate(s, allocator, m, operation++);
+    }
+    for (size_t i = 0; i < CHURN_OPERATIONS; i++)
+    {
+        size_t victim = next_random(&state) % POOL_OBJECTS;
+        if (live[victim]) { deallocate(s, allocator, m, live[victim]); }
+        live[victim] = allocate(s, allocator, m, operation++);
+    }
+    for (size_t i = 0; i < POOL_OBJECTS; i++)
+    {
+        if (live[i]) { deallocate(s, allocator, m, live[i]); }
+    }
+
+    free(live);
+    if (allocator) { op_ll_deinitialize_allocator(allocator); }
+}
+
+static void print_histogram(const char *name, const histogram *h, const char *separator)
+{
+    fprintf(stdout, "      \"%s\": { \"count\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p99_9_ns\": %llu, "
+            "\"max_ns\": %llu }%s\n", name, (unsigned long long) h->total,
+            (unsigned long long) percentile(h, 50.0), (unsigned long long) percentile(h, 99.0),
+            (unsigned long long) percentile(h, 99.9), (unsigned long long) h->max, separator);
+}
+
+int main(void)
+{
+    /* the cheapest back-to-back reading shows how much of every sample is the clock itself */
+    uint64_t clock_ns = UINT64_MAX;
+    for (size_t i = 0; i < 1000; i++)
+    {
+        uint64_t start = now_ns(), elapsed = now_ns() - start;
+        clock_ns = elapsed < clock_ns ? elapsed : clock_ns;
+    }
+
+    fprintf(stdout, "{\n  \"benchmark\": \"tail latency\",\n  \"object_size\": %d,\n  \"pool_objects\": %d,\n"
+            "  \"churn_operations\": %d,\n  \"initial_count\": %d,\n  \"clock_overhead_ns\": %llu,\n  \"results\": [\n",
+            OBJECT_SIZE, POOL_OBJECTS, CHURN_OPERATIONS, INITIAL_COUNT, (unsigned long long) clock_ns);
+    for (size_t s = 0; s < sizeof(subjects) / sizeof(subjects[0]); s++)
+    {
+        measurement *m = calloc(1, sizeof(measurement));
+        run(&subjects[s], m);
+
+        histogram all = m->allocations;
+        for (size_t b = 0; b < BUCKETS; b++)
+        {
+            all.counts[b] += m->growths.counts[b];
+        }
+        all.total += m->growths.total;
+        all.max = m->growths.max > all.max ? m->growths.max : all.max;
+
+        fprintf(stdout, "    {\n      \"allocator\": \"%s\",\n      \"bounded_latency\": %s,\n"
+                "      \"failed_allocations\": %zu,\n", subjects[s].name, subjects[s].bounded ? "true" : "false",
+                m->failures);
+        print_histogram("allocations", &all, ",");
+        print_histogram("allocations_without_growth", &m->allocations, ",");
+        print_histogram("growth_allocations", &m->growths, ",");
+        print_histogram("deallocations", &m->deallocations, ",");
+        print_histogram("maintenance", &m->maintenance, ",");
+        fprintf(stdout, "      \"slowest_growths\": [");
+        for (size_t g = 0; g < m->slowest_count; g++)
+        {
+            fprintf(stdout, "%s\n        { \"operation\": %llu, \"ns\": %llu, \"capacity_before\": %zu, "
+                    "\"capacity_after\": %zu }", g ? "," : "", (unsigned long long) m->slowest[g].operation,
+                    (unsigned long long) m->slowest[g].ns, m->slowest[g].capacity_before,
+                    m->slowest[g].capacity_after);
+        }
+        fprintf(stdout, "%s]\n    }%s\n", m->slowest_count ? "\n      " : "",
+                s + 1 < sizeof(subjects) / sizeof(subjects[0]) ? "," : "");
+        fflush(stdout);
+        free(m);
+    }
+    fprintf(stdout, "  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,317 @@
+/******************************************************************************
+* (c)2022 Michael T. Richter
+*
+* This software is distributed under the terms of WTFPLv2.  The full terms and
+* text of the license can be found at http://www.wtfpl.net/txt/copying
+******************************************************************************/
+#include "opalloc.h"
+#include "opalloc_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Allocator mode benchmark.
+ *
+ * Every allocator mode, with the default and the LIFO placement policy, and the
+ * C library's malloc() fill a pool of live objects and then free all of them,
+ * over and over.  The objects are freed in the order they were allocated
+ * (FIFO), in the reverse order (LIFO) or in a random order, which is shuffled
+ * afresh for every round.  Each run covers one object size, pool size and
+ * pattern, and reports the average time of an allocation and of a
+ * deallocation, the resulting throughput and the speedup over malloc().
+ *
+ * The first round of every run warms the allocator up, growing it to the pool
+ * size, and is not measured.  Every object has its first byte written so that
+ * malloc() cannot get away with handing out untouched memory.
+ *
+ * Results are written to stdout as JSON, e.g. `./bin/opabench > modes.json`.
+ *
+ * With `--trace`, every allocator run is repeated straight away while a trace
+ * records it to a scratch file, and the result reports the overhead of
+ * tracing over the untraced run.  This needs tracing compiled in
+ * (`./bin/opabench-trace`).  Given the results of another build as a
+ * baseline, every result also reports its overhead over the same run there.
+ * The output ends with the median of each overhead over the allocators.
+ * `make bench` measures both costs of tracing, compiled in and running, with
+ *
+ *     ./bin/opabench-trace --trace bin/opabench.out
+ *
+ * Runs in separate processes vary far more than runs in the same one, so the
+ * baseline comparison is only a rough guide.
+ */
+
+#define OPS_PER_RUN   100000     /* allocations measured per run, rounded up to whole rounds */
+#define INITIAL_COUNT 64
+
+typedef enum pattern
+{
+    PATTERN_LIFO,
+    PATTERN_FIFO,
+    PATTERN_RANDOM,
+} pattern;
+
+typedef struct subject
+{
+    const char *name;
+    bool use_malloc;
+    op_ll_allocator_mode mode;
+    op_ll_placement_policy placement;
+} subject;
+
+typedef struct result
+{
+    double allocate_ns;
+    double free_ns;
+} result;
+
+static const char *pattern_names[] = { "lifo", "fifo", "random" };
+
+static const subject subjects[] =
+{
+    { "malloc",              true,  OP_DOUBLING_INDIVIDUAL, OP_PLACE_LOWEST_INDEX },
+    { "doubling_individual", false, OP_DOUBLING_INDIVIDUAL, OP_PLACE_LOWEST_INDEX },
+    { "doubling_individual", false, OP_DOUBLING_INDIVIDUAL, OP_PLACE_LIFO },
+    { "doubling_chunk",      false, OP_DOUBLING_CHUNK,      OP_PLACE_LOWEST_INDEX },
+    { "doubling_chunk",      false, OP_DOUBLING_CHUNK,      OP_PLACE_LIFO },
+    { "linear_individual",   false, OP_LINEAR_INDIVIDUAL,   OP_PLACE_LOWEST_INDEX },
+    { "linear_individual",   false, OP_LINEAR_INDIVIDUAL,   OP_PLACE_LIFO },
+    { "linear_chunk",        false, OP_LINEAR_CHUNK,        OP_PLACE_LOWEST_INDEX },
+    { "linear_chunk",        false, OP_LINEAR_CHUNK,        OP_PLACE_LIFO },
+};
+
+static const size_t object_sizes[] = { 8, 64, 512, 4096, 8192 };
+static const size_t pool_sizes[] = { 1000, 10000 };
+
+#define SUBJECT_COUNT (sizeof(subjects) / sizeof(subjects[0]))
+#define RUN_COUNT     (sizeof(object_sizes) / sizeof(object_sizes[0]) * sizeof(pool_sizes) / sizeof(pool_sizes[0]) \
+                       * (PATTERN_RANDOM + 1) * SUBJECT_COUNT)
+
+static void order_frees(size_t *order, const size_t count, const pattern p, uint64_t *state)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        order[i] = p == PATTERN_LIFO ? count - 1 - i : i;
+    }
+    for (size_t i = count - 1; p == PATTERN_RANDOM && i > 0; i--)
+    {
+        size_t j = next_random(state) % (i + 1);
+        size_t swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+}
+
+static bool start_trace(char *path)
+{
+    bool rv = false;
+    int fd = mkstemp(path);
+    if (fd >= 0)
+    {
+        close(fd);
+        rv = op_ll_trace_start(path);
+        if (!rv)
+        {
+            unlink(path);
+        }
+    }
+    return rv;
+}
+
+static void stop_trace(const char *path)
+{
+    op_ll_trace_stop();
+    unlink(path);
+}
+
+/* every result sits on a line of its own, in the order the runs are made */
+static size_t read_baseline(const char *path, double *pair_ns, const size_t capacity)
+{
+    size_t rv = 0;
+    FILE *file = fopen(path, "r");
+    char line[1024];
+    while (file && rv < capacity && fgets(line, sizeof(line), file))
+    {
+        const char *allocate = strstr(line, "\"allocate_ns\": "), *deallocate = strstr(line, "\"free_ns\": ");
+        if (allocate && deallocate)
+        {
+            pair_ns[rv++] = strtod(allocate + strlen("\"allocate_ns\": "), NULL)
+                            + strtod(deallocate + strlen("\"free_ns\": "), NULL);
+        }
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+    return rv;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double lhs = *(const double *) a, rhs = *(const double *) b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static double median(double *values, const size_t count)
+{
+    qsort(values, count, sizeof(double), compare_double);
+    return values[count / 2];
+}
+
+static result run(const subject *s, const size_t object_size, const size_t pool_size, const pattern p,
+                  const bool trace)
+{
+    op_allocator allocator = NULL;
+    if (!s->use_malloc)
+    {
+        op_allocator_config config = op_ll_default_allocator_config();
+        config.placement = s->placement;
+        allocator = op_ll_initialize_configured_allocator(object_size, INITIAL_COUNT, s->mode, &config);
+    }
+    char **objects = malloc(pool_size * sizeof(char *));
+    size_t *order = malloc(pool_size * sizeof(size_t));
+    uint64_t state = BENCH_RANDOM_SEED;
+
+    /* full rings are written out as the run goes, which is part of the cost being measured */
+    char trace_path[] = "/tmp/opabench_trace_XXXXXX";
+    bool traced = trace && start_trace(trace_path);
+
+    size_t rounds = (OPS_PER_RUN + pool_size - 1) / pool_size;
+    double allocating = 0, freeing = 0;
+    for (size_t round = 0; round <= rounds; round++)
+    {
+        order_frees(order, pool_size, p, &state);
+
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < pool_size; i++)
+        {
+            objects[i] = s->use_malloc ? malloc(object_size) : op_ll_allocate_object(allocator);
+        }
+        uint64_t allocated = now_ns();
+        for (size_t i = 0; i < pool_size; i++)
+        {
+            objects[i][0] = (char) i;
+        }
+        uint64_t touched = now_ns();
+        for (size_t i = 0; i < pool_size; i++)
+        {
+            if (s->use_malloc) { free(objects[order[i]]); }
+            else               { op_ll_deallocate_object(allocator, objects[order[i]]); }
+        }
+        uint64_t freed = now_ns();
+
+        if (round > 0)
+        {
+            allocating += allocated - start;
+            freeing += freed - touched;
+        }
+    }
+
+    if (traced)
+    {
+        stop_trace(trace_path);
+    }
+    free(order);
+    free(objects);
+    if (allocator) { op_ll_deinitialize_allocator(allocator); }
+
+    double ops = (double) rounds * pool_size;
+    return (result) { .allocate_ns = allocating / ops, .free_ns = freeing / ops };
+}
+
+int main(int argc, char **argv)
+{
+    bool tracing = false;
+    const char *baseline_path = NULL;
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "--trace") == 0)
+        {
+            tracing = true;
+        }
+        else
+        {
+            baseline_path = argv[a];
+        }
+    }
+
+    char trace_path[] = "/tmp/opabench_trace_XXXXXX";
+    if (tracing && !start_trace(trace_path))
+    {
+        fprintf(stderr, "Tracing is not compiled in; use ./bin/opabench-trace or build with USE_TRACE=true.\n");
+        return 1;
+    }
+    if (tracing)
+    {
+        stop_trace(trace_path);
+    }
+
+    static double baseline_ns[RUN_COUNT], baseline_overheads[RUN_COUNT], trace_overheads[RUN_COUNT];
+    size_t baseline_count = 0, trace_count = 0;
+    if (baseline_path && read_baseline(baseline_path, baseline_ns, RUN_COUNT) != RUN_COUNT)
+    {
+        fprintf(stderr, "%s does not hold the results of a complete run.\n", baseline_path);
+        return 1;
+    }
+
+    fprintf(stdout, "{\n  \"benchmark\": \"allocator modes\",\n  \"ops_per_run\": %d,\n  \"results\": [", OPS_PER_RUN);
+    const char *separator = "\n";
+    size_t run_index = 0;
+    for (size_t z = 0; z < sizeof(object_sizes) / sizeof(object_sizes[0]); z++)
+    {
+        for (size_t n = 0; n < sizeof(pool_sizes) / sizeof(pool_sizes[0]); n++)
+        {
+            for (pattern p = PATTERN_LIFO; p <= PATTERN_RANDOM; p++)
+            {
+                /* malloc() comes first in the list, so every other subject is compared with it */
+                double baseline = 0;
+                for (size_t s = 0; s < SUBJECT_COUNT; s++, run_index++)
+                {
+                    result r = run(&subjects[s], object_sizes[z], pool_sizes[n], p, false);
+                    double pair_ns = r.allocate_ns + r.free_ns;
+                    if (subjects[s].use_malloc)
+                    {
+                        baseline = pair_ns;
+                    }
+                    const char *placement = subjects[s].use_malloc ? "n/a"
+                                            : subjects[s].placement == OP_PLACE_LIFO ? "lifo" : "lowest_index";
+                    fprintf(stdout, "%s    { \"allocator\": \"%s\", \"placement\": \"%s\", \"object_size\": %zu, "
+                            "\"pool_objects\": %zu, \"pattern\": \"%s\", \"allocate_ns\": %.2f, \"free_ns\": %.2f, "
+                            "\"pairs_per_second\": %.0f, \"speedup_vs_malloc\": %.3f",
+                            separator, subjects[s].name, placement,
+                            object_sizes[z], pool_sizes[n], pattern_names[p], r.allocate_ns, r.free_ns,
+                            1e9 / pair_ns, baseline / pair_ns);
+                    if (baseline_path && !subjects[s].use_malloc)
+                    {
+                        baseline_overheads[baseline_count] = pair_ns / baseline_ns[run_index] - 1;
+                        fprintf(stdout, ", \"overhead_vs_baseline\": %.3f", baseline_overheads[baseline_count++]);
+                    }
+                    if (tracing && !subjects[s].use_malloc)
+                    {
+                        /* straight after the untraced run, so that both see the machine in the same state */
+                        result t = run(&subjects[s], object_sizes[z], pool_sizes[n], p, true);
+                        trace_overheads[trace_count] = (t.allocate_ns + t.free_ns) / pair_ns - 1;
+                        fprintf(stdout, ", \"traced_allocate_ns\": %.2f, \"traced_free_ns\": %.2f, "
+                                "\"trace_overhead\": %.3f", t.allocate_ns, t.free_ns, trace_overheads[trace_count++]);
+                    }
+                    fprintf(stdout, " }");
+                    separator = ",\n";
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+    fprintf(stdout, "\n  ]");
+    if (baseline_count > 0)
+    {
+        fprintf(stdout, ",\n  \"median_overhead_vs_baseline\": %.3f", median(baseline_overheads, baseline_count));
+    }
+    if (trace_count > 0)
+    {
+        fprintf(stdout, ",\n  \"median_trace_overhead\": %.3f", median(trace_overheads, trace_count));
+    }
+    fprintf(stdout, "\n}\n");
+    return 0;
+}
@@ -0,0 +1,353 @@
+/******************************************************************************
+* (c)2022 Michael T. Richter
+*
+* This software is distributed under the terms of WTFPLv2.  The full terms and
+* text of the license can be found at http://www.wtfpl.net/txt/copying
+******************************************************************************/
+#include "opalloc.h"
+#include "opalloc_bench.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#define OP_CAN_THREAD 1
+#else
+#define OP_CAN_THREAD 0
+#endif
+
+/*
+ * Multi-threaded scalability benchmark.
+ *
+ * Runs 1 to MAX_THREADS threads, doubling, which allocate and free objects in
+ * three patterns:
+ *
+ *   - local: every thread frees the objects it allocated, BATCH at a time;
+ *   - producer_consumer: threads are paired, one allocating and handing its
+ *     objects to the other, which frees them (even thread counts only);
+ *   - all_to_all: every thread hands its objects round-robin to every thread,
+ *     itself included, and frees whatever it is handed.
+ *
+ * Objects travel through single-producer, single-consumer rings, one for
+ * every ordered pair of threads, so the hand-over itself needs no locks.  A
+ * thread whose ring is full frees what it has been handed until there is
+ * room, which keeps every pattern free of deadlock.
+ *
+ * The subjects are malloc(), an ordinary linear chunk allocator behind one
+ * mutex, which is how the allocator has to be shared between threads, and a
+ * shared pool, whose free list is lock-free.  Every run reports the
+ * throughput in allocation and free pairs per second, its scaling over the
+ * pattern's smallest thread count, and the memory the subject holds
+ * afterwards per thread.  Pools never shrink here, so that is their peak;
+ * for malloc() it is what the run added to its arenas.
+ *
+ * Results are written to stdout as JSON, e.g. `./bin/opamt > threads.json`.
+ * The maximum thread count and the operations per thread may be given as
+ * arguments, which `make tsan` uses to run a short pass under
+ * ThreadSanitizer.
+ */
+
+#define MAX_THREADS    8
+#define OPERATIONS     1000000      /* allocations per thread, rounded up to a multiple of BATCH * MAX_THREADS */
+#define BATCH          256
+#define RING_SLOTS     256          /* a power of two */
+#define OBJECT_SIZE    64
+#define INITIAL_COUNT  1024
+#define SHARED_CAPACITY (1 << 17)   /* more than BATCH per thread plus every ring full at MAX_THREADS */
+
+typedef enum pattern
+{
+    PATTERN_LOCAL,
+    PATTERN_PRODUCER_CONSUMER,
+    PATTERN_ALL_TO_ALL,
+} pattern;
+
+typedef enum subject
+{
+    SUBJECT_MALLOC,
+    SUBJECT_MUTEX,
+    SUBJECT_SHARED,
+} subject;
+
+typedef struct ring
+{
+    _Atomic size_t head;            /* written by the consumer */
+    char padding[64 - sizeof(size_t)];
+    _Atomic size_t tail;            /* written by the producer */
+    char padding_after[64 - sizeof(size_t)];
+    void *slots[RING_SLOTS];
+} ring;
+
+typedef struct run_state
+{
+    subject s;
+    pattern p;
+    size_t threads;
+    size_t operations;
+    op_allocator allocator;
+#if OP_CAN_THREAD
+    pthread_mutex_t lock;
+#endif
+    ring *rings;                    /* rings[from * threads + to] */
+    _Atomic bool go;
+} run_state;
+
+typedef struct worker
+{
+    run_state *run;
+    size_t id;
+} worker;
+
+static const char *pattern_names[] = { "local", "producer_consumer", "all_to_all" };
+static const char *subject_names[] = { "malloc", "mutex_linear_chunk", "shared_lock_free" };
+
+#if OP_CAN_THREAD
+
+static void *allocate(run_state *r)
+{
+    void *rv;
+    if (r->s == SUBJECT_MALLOC)
+    {
+        rv = malloc(OBJECT_SIZE);
+    }
+    else if (r->s == SUBJECT_MUTEX)
+    {
+        pthread_mutex_lock(&r->lock);
+        rv = op_ll_allocate_object(r->allocator);
+        pthread_mutex_unlock(&r->lock);
+    }
+    else
+    {
+        rv = op_ll_allocate_object(r->allocator);
+    }
+    if (rv)
+    {
+        *(volatile char *) rv = 1;
+    }
+    return rv;
+}
+
+static void deallocate(run_state *r, void *object)
+{
+    if (r->s == SUBJECT_MALLOC)
+    {
+        free(object);
+    }
+    else if (r->s == SUBJECT_MUTEX)
+    {
+        pthread_mutex_lock(&r->lock);
+        op_ll_deallocate_object(r->allocator, object);
+        pthread_mutex_unlock(&r->lock);
+    }
+    else
+    {
+        op_ll_deallocate_object(r->allocator, object);
+    }
+}
+
+static bool ring_push(ring *q, void *object)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&q->head, memory_order_acquire) == RING_SLOTS)
+    {
+        return false;
+    }
+    q->slots[tail % RING_SLOTS] = object;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static void *ring_pop(ring *q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&q->tail, memory_order_acquire))
+    {
+        return NULL;
+    }
+    void *rv = q->slots[head % RING_SLOTS];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return rv;
+}
+
+static size_t drain(run_state *r, const size_t id)
+{
+    /* free whatever the other threads have handed this one */
+    size_t rv = 0;
+    for (size_t from = 0; from < r->threads; from++)
+    {
+        void *object;
+        while ((object = ring_pop(&r->rings[from * r->threads + id])) != NULL)
+        {
+            deallocate(r, object);
+            rv++;
+        }
+    }
+    return rv;
+}
+
+static size_t wait_and_drain(run_state *r, const size_t id)
+{
+    /* with more threads than cores, spinning would only keep the others from running */
+    size_t rv = drain(r, id);
+    if (rv == 0)
+    {
+        sched_yield();
+    }
+    return rv;
+}
+
+static void *work(void *argument)
+{
+    worker *w = argument;
+    run_state *r = w->run;
+    while (!atomic_load_explicit(&r->go, memory_order_acquire))
+    {
+        sched_yield();      /* wait for every thread to be ready */
+    }
+
+    if (r->p == PATTERN_LOCAL)
+    {
+        void *batch[BATCH];
+        for (size_t done = 0; done < r->operations; done += BATCH)
+        {
+            for (size_t i = 0; i < BATCH; i++)
+            {
+                batch[i] = allocate(r);
+            }
+            for (size_t i = 0; i < BATCH; i++)
+            {
+                deallocate(r, batch[i]);
+            }
+        }
+        return NULL;
+    }
+
+    /* producers send, consumers receive, and in all_to_all every thread does both */
+    bool producer = r->p == PATTERN_ALL_TO_ALL || w->id % 2 == 0;
+    bool consumer = r->p == PATTERN_ALL_TO_ALL || w->id % 2 == 1;
+    size_t expected = consumer ? r->operations : 0, received = 0;
+    for (size_t i = 0; producer && i < r->operations; i++)
+    {
+        size_t to = r->p == PATTERN_ALL_TO_ALL ? (w->id + i) % r->threads : w->id + 1;
+        void *object = allocate(r);
+        while (!ring_push(&r->rings[w->id * r->threads + to], object))
+        {
+            received += wait_and_drain(r, w->id);
+        }
+    }
+    while (received < expected)
+    {
+        received += wait_and_drain(r, w->id);
+    }
+    return NULL;
+}
+
+static size_t held_bytes(const run_state *r)
+{
+    size_t rv = 0;
+    if (r->s == SUBJECT_MALLOC)
+    {
+#if defined(__GLIBC__)
+        struct mallinfo2 info = mallinfo2();
+        rv = info.arena + info.hblkhd;
+#endif
+    }
+    else
+    {
+        rv = op_ll_get_allocator_stats(r->allocator).resident_bytes;
+    }
+    return rv;
+}
+
+static double run(const subject s, const pattern p, const size_t threads, const size_t operations, size_t *held)
+{
+    run_state *r = calloc(1, sizeof(run_state));
+    *r = (run_state) { .s = s, .p = p, .threads = threads, .operations = operations };
+    r->rings = calloc(threads * threads, sizeof(ring));
+    pthread_mutex_init(&r->lock, NULL);
+    if (s == SUBJECT_MUTEX)
+    {
+        op_allocator_config config = op_ll_default_allocator_config();
+        config.placement = OP_PLACE_LIFO;
+        r->allocator = op_ll_initialize_configured_allocator(OBJECT_SIZE, INITIAL_COUNT, OP_LINEAR_CHUNK, &config);
+    }
+    else if (s == SUBJECT_SHARED)
+    {
+        r->allocator = op_ll_create_shared(NULL, OBJECT_SIZE, SHARED_CAPACITY);
+    }
+    size_t before = s == SUBJECT_MALLOC ? held_bytes(r) : 0;
+
+    pthread_t ids[MAX_THREADS];
+    worker workers[MAX_THREADS];
+    for (size_t t = 0; t < threads; t++)
+    {
+        workers[t] = (worker) { .run = r, .id = t };
+        pthread_create(&ids[t], NULL, work, &workers[t]);
+    }
+    uint64_t start = now_ns();
+    atomic_store_explicit(&r->go, true, memory_order_release);
+    for (size_t t = 0; t < threads; t++)
+    {
+        pthread_join(ids[t], NULL);
+    }
+    double elapsed = now_ns() - start;
+
+    size_t after = held_bytes(r);
+    *held = after > before ? after - before : 0;
+    if (r->allocator) { op_ll_deinitialize_allocator(r->allocator); }
+    pthread_mutex_destroy(&r->lock);
+    free(r->rings);
+    free(r);
+
+    /* every producing thread allocates `operations` objects and all of them are freed */
+    size_t producers = p == PATTERN_PRODUCER_CONSUMER ? threads / 2 : threads;
+    return producers * operations / (elapsed / 1e9);
+}
+
+int main(int argc, char **argv)
+{
+    size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : MAX_THREADS;
+    size_t operations = argc > 2 ? strtoul(argv[2], NULL, 10) : OPERATIONS;
+    max_threads = max_threads < 1 ? 1 : max_threads > MAX_THREADS ? MAX_THREADS : max_threads;
+    operations = (operations + BATCH * MAX_THREADS - 1) / (BATCH * MAX_THREADS) * (BATCH * MAX_THREADS);
+
+    fprintf(stdout, "{\n  \"benchmark\": \"thread scalability\",\n  \"object_size\": %d,\n"
+            "  \"operations_per_thread\": %zu,\n  \"results\": [", OBJECT_SIZE, operations);
+    const char *separator = "\n";
+    for (pattern p = PATTERN_LOCAL; p <= PATTERN_ALL_TO_ALL; p++)
+    {
+        for (subject s = SUBJECT_MALLOC; s <= SUBJECT_SHARED; s++)
+        {
+            double baseline = 0;
+            for (size_t threads = p == PATTERN_PRODUCER_CONSUMER ? 2 : 1; threads <= max_threads; threads *= 2)
+            {
+                size_t held = 0;
+                double pairs = run(s, p, threads, operations, &held);
+                baseline = baseline ? baseline : pairs;
+                fprintf(stdout, "%s    { \"pattern\": \"%s\", \"allocator\": \"%s\", \"threads\": %zu, "
+                        "\"pairs_per_second\": %.0f, \"scaling\": %.3f, \"held_bytes\": %zu, "
+                        "\"held_bytes_per_thread\": %zu }", separator, pattern_names[p], subject_names[s], threads,
+                        pairs, pairs / baseline, held, held / threads);
+                separator = ",\n";
+                fflush(stdout);
+            }
+        }
+    }
+    fprintf(stdout, "\n  ]\n}\n");
+    return 0;
+}
+
+#else
+
+int main(void)
+{
+    fprintf(stderr, "The thread scalability benchmark needs POSIX threads.\n");
+    return 0;
+}
+
+#endif
@@ -1,7 +1,18 @@
 #include "opalloc.h"
 
 #include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define MINIMUM_ALLOCATION_COUNT 4
 #define UNUSED(X)                ((void)(X))
@@ -18,6 +29,9 @@ typedef struct test_object
 } test_object;
 typedef void (*test_func)(void);
 
+/* the message of the most recent error, for tests which check why something failed */
+static const char *_Atomic last_error = NULL;
+
 /*
  * Multiple allocators can be made.  Allocators clean up properly.
  */
@@ -316,6 +330,1599 @@ static void ll_test8(void)
     UNUSED(item1i);
 }
 
+typedef struct relocation_log
+{
+    size_t count;
+    test_object *moved[16];
+} relocation_log;
+
+static void log_relocation(void *context, void *old_object, void *new_object)
+{
+    relocation_log *log = context;
+    for (size_t i = 0; i < 16; i++)
+    {
+        if (log->moved[i] == old_object)
+        {
+            log->moved[i] = new_object;
+        }
+    }
+    log->count++;
+}
+
+/*
+ * Compaction moves live objects out of sparse chunks, keeps their contents, leaves pinned objects alone and frees the
+ * chunks it empties.  Freed chunks are backed again on demand.
+ */
+static void ll_test9(void)
+{
+    op_allocator allocator1 = op_ll_initialize_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT, OP_LINEAR_CHUNK);
+
+    relocation_log log = { 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        log.moved[i] = op_ll_allocate_object(allocator1);
+        log.moved[i]->stack_size = i;
+    }
+
+    /* chunk 0 keeps 3 objects, chunk 1 keeps 1, chunk 2 keeps 1 (pinned), chunk 3 keeps 2 */
+    int keep[] = { 0, 1, 2, 5, 10, 12, 13 };
+    for (int i = 0; i < 16; i++)
+    {
+        bool kept = false;
+        for (size_t k = 0; k < sizeof(keep) / sizeof(keep[0]); k++) { kept |= keep[k] == i; }
+        if (!kept)
+        {
+            op_ll_deallocate_object(allocator1, log.moved[i]);
+            log.moved[i] = NULL;
+        }
+    }
+    test_object *pinned = log.moved[10];
+    op_ll_pin_object(allocator1, pinned, true);
+
+    assert(op_ll_compact(allocator1, log_relocation, &log) == 1);
+    assert(log.count == 1);
+    assert(log.moved[10] == pinned);
+    for (size_t k = 0; k < sizeof(keep) / sizeof(keep[0]); k++)
+    {
+        assert(log.moved[keep[k]]->stack_size == keep[k]);
+    }
+
+    op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+    assert(stats.maximum_objects == 16);
+    assert(stats.active_objects == 7);
+
+    /* fill every hole, which backs the freed chunk again without growing */
+    for (int i = 0; i < 9; i++)
+    {
+        test_object *item = op_ll_allocate_object(allocator1);
+        assert(item != NULL);
+        assert(item->stack_size == 0);
+    }
+    stats = op_ll_get_allocator_stats(allocator1);
+    assert(stats.maximum_objects == 16);
+    assert(stats.active_objects == 16);
+
+    op_ll_deinitialize_allocator(allocator1);
+}
+
+/*
+ * Compacting without a relocation callback only frees what is already unused.
+ */
+static void ll_test10(void)
+{
+    op_allocator allocator1 = op_ll_initialize_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_DOUBLING_INDIVIDUAL);
+    op_allocator allocator2 = op_ll_initialize_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_DOUBLING_CHUNK);
+
+    test_object *items1[8], *items2[8];
+    for (size_t i = 0; i < 8; i++)
+    {
+        items1[i] = op_ll_allocate_object(allocator1);
+        items2[i] = op_ll_allocate_object(allocator2);
+    }
+    for (size_t i = 1; i < 8; i += 2)
+    {
+        op_ll_deallocate_object(allocator1, items1[i]);
+    }
+    for (size_t i = 4; i < 8; i++)
+    {
+        op_ll_deallocate_object(allocator2, items2[i]);
+    }
+
+    assert(op_ll_compact(allocator1, NULL, NULL) == 4);
+    assert(op_ll_compact(allocator2, NULL, NULL) == 1);
+    assert(op_ll_get_allocator_stats(allocator1).active_objects == 4);
+    assert(op_ll_get_allocator_stats(allocator2).active_objects == 4);
+
+    op_ll_deinitialize_allocator(allocator1);
+    op_ll_deinitialize_allocator(allocator2);
+}
+
+/*
+ * Placement policies pick the expected free slot.
+ */
+static void ll_test11(void)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+
+    config.placement = OP_PLACE_LIFO;
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_DOUBLING_CHUNK, &config);
+    test_object *item1a = op_ll_allocate_object(allocator1);
+    test_object *item1b = op_ll_allocate_object(allocator1);
+    test_object *item1c = op_ll_allocate_object(allocator1);
+    assert(item1a != item1b && item1b != item1c);
+    op_ll_deallocate_object(allocator1, item1a);
+    op_ll_deallocate_object(allocator1, item1c);
+    assert(op_ll_allocate_object(allocator1) == item1c);
+    assert(op_ll_allocate_object(allocator1) == item1a);
+
+    config.placement = OP_PLACE_MOST_FULL;
+    op_allocator allocator2 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    test_object *items2[8];
+    for (size_t i = 0; i < 8; i++)
+    {
+        items2[i] = op_ll_allocate_object(allocator2);
+    }
+    for (size_t i = 0; i < 3; i++)
+    {
+        op_ll_deallocate_object(allocator2, items2[i]);
+    }
+    op_ll_deallocate_object(allocator2, items2[6]);
+    assert(op_ll_allocate_object(allocator2) == items2[6]);
+    assert(op_ll_allocate_object(allocator2) == items2[0]);
+
+    config.placement = OP_PLACE_ADDRESS_ORDERED;
+    op_allocator allocator3 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_INDIVIDUAL, &config);
+    test_object *items3[8], *lowest = NULL;
+    for (size_t i = 0; i < 8; i++)
+    {
+        items3[i] = op_ll_allocate_object(allocator3);
+    }
+    for (size_t i = 1; i < 8; i += 3)
+    {
+        op_ll_deallocate_object(allocator3, items3[i]);
+        if (lowest == NULL || items3[i] < lowest) { lowest = items3[i]; }
+    }
+    assert(op_ll_allocate_object(allocator3) == lowest);
+
+    op_ll_deinitialize_allocator(allocator1);
+    op_ll_deinitialize_allocator(allocator2);
+    op_ll_deinitialize_allocator(allocator3);
+}
+
+/*
+ * Sorting the free list makes subsequent allocations ascend through memory, on request or automatically.
+ */
+static void ll_test12(void)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.placement = OP_PLACE_LIFO;
+
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), 16, OP_LINEAR_CHUNK, &config);
+    test_object *items[16];
+    for (size_t i = 0; i < 16; i++)
+    {
+        items[i] = op_ll_allocate_object(allocator1);
+    }
+    size_t order[] = { 9, 2, 14, 5, 11, 0, 7 };
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++)
+    {
+        op_ll_deallocate_object(allocator1, items[order[i]]);
+    }
+    assert(op_ll_allocate_object(allocator1) == items[7]);
+    op_ll_deallocate_object(allocator1, items[7]);
+
+    op_ll_optimize_free_list(allocator1);
+    assert(op_ll_allocate_object(allocator1) == items[0]);
+    assert(op_ll_allocate_object(allocator1) == items[2]);
+    assert(op_ll_allocate_object(allocator1) == items[5]);
+    op_ll_deinitialize_allocator(allocator1);
+
+    config.free_list_sort_interval = 4;
+    op_allocator allocator2 = op_ll_initialize_configured_allocator(sizeof(test_object), 16, OP_LINEAR_CHUNK, &config);
+    for (size_t i = 0; i < 16; i++)
+    {
+        items[i] = op_ll_allocate_object(allocator2);
+    }
+    op_ll_deallocate_object(allocator2, items[12]);
+    op_ll_deallocate_object(allocator2, items[3]);
+    op_ll_deallocate_object(allocator2, items[8]);
+    op_ll_deallocate_object(allocator2, items[1]);  /* 20th operation sorts the free list */
+    assert(op_ll_allocate_object(allocator2) == items[1]);
+    assert(op_ll_allocate_object(allocator2) == items[3]);
+    assert(op_ll_allocate_object(allocator2) == items[8]);
+    op_ll_deinitialize_allocator(allocator2);
+}
+
+/*
+ * Lifetime hints keep short-lived and long-lived objects in separate chunks, so freeing every short-lived object
+ * leaves whole chunks to release, until the pool reaches its limit.
+ */
+static void ll_test13(void)
+{
+    op_allocator allocator1 = op_ll_initialize_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT, OP_LINEAR_CHUNK);
+
+    test_object *short_lived[5], *long_lived[2];
+    for (size_t i = 0; i < 3; i++)
+    {
+        short_lived[i] = op_ll_allocate_object_hint(allocator1, OP_HINT_SHORT_LIVED);
+    }
+    long_lived[0] = op_ll_allocate_object_hint(allocator1, OP_HINT_LONG_LIVED);
+    long_lived[1] = op_ll_allocate_object_hint(allocator1, OP_HINT_LONG_LIVED);
+    short_lived[3] = op_ll_allocate_object_hint(allocator1, OP_HINT_SHORT_LIVED);
+    short_lived[4] = op_ll_allocate_object_hint(allocator1, OP_HINT_SHORT_LIVED);
+
+    op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+    assert(stats.maximum_objects == 12);
+    assert(stats.active_objects == 7);
+
+    for (size_t i = 0; i < 5; i++)
+    {
+        op_ll_deallocate_object(allocator1, short_lived[i]);
+    }
+    assert(op_ll_compact(allocator1, NULL, NULL) == 2);
+    assert(op_ll_get_allocator_stats(allocator1).active_objects == 2);
+
+    /* a freshly emptied chunk can take either lifetime again */
+    test_object *item = op_ll_allocate_object_hint(allocator1, OP_HINT_LONG_LIVED);
+    assert(item != NULL);
+    assert(op_ll_get_allocator_stats(allocator1).maximum_objects == 12);
+
+    /* a pool at its limit shares a chunk of another lifetime rather than fail, then overflows as usual */
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.max_objects = 2 * MINIMUM_ALLOCATION_COUNT;
+    config.overflow = OP_OVERFLOW_MALLOC;
+    op_allocator allocator2 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    test_object *items[2 * MINIMUM_ALLOCATION_COUNT + 1];
+    for (size_t i = 0; i < 2 * MINIMUM_ALLOCATION_COUNT + 1; i++)
+    {
+        items[i] = op_ll_allocate_object_hint(allocator2, i < 2 ? OP_HINT_SHORT_LIVED : OP_HINT_LONG_LIVED);
+        assert(items[i] != NULL);
+    }
+    stats = op_ll_get_allocator_stats(allocator2);
+    assert(stats.maximum_objects == 2 * MINIMUM_ALLOCATION_COUNT);
+    assert(stats.active_objects == 2 * MINIMUM_ALLOCATION_COUNT);
+    assert(stats.capped_allocations == 1);
+    for (size_t i = 0; i < 2 * MINIMUM_ALLOCATION_COUNT + 1; i++)
+    {
+        op_ll_deallocate_object(allocator2, items[i]);
+    }
+
+    op_ll_deinitialize_allocator(allocator2);
+    op_ll_deinitialize_allocator(allocator1);
+    UNUSED(long_lived);
+}
+
+/*
+ * Allocating near a neighbor picks the closest free slot of the neighbor's chunk, or any slot if it is full.
+ */
+static void ll_test14(void)
+{
+    op_allocator allocator1 = op_ll_initialize_allocator(sizeof(test_object), 8, OP_LINEAR_CHUNK);
+
+    test_object *items[16];
+    for (size_t i = 0; i < 16; i++)
+    {
+        items[i] = op_ll_allocate_object(allocator1);
+    }
+    op_ll_deallocate_object(allocator1, items[1]);
+    op_ll_deallocate_object(allocator1, items[6]);
+    op_ll_deallocate_object(allocator1, items[12]);
+
+    assert(op_ll_allocate_near(allocator1, items[5]) == items[6]);
+    assert(op_ll_allocate_near(allocator1, items[14]) == items[12]);
+    assert(op_ll_allocate_near(allocator1, items[0]) == items[1]);
+
+    test_object *item = op_ll_allocate_near(allocator1, items[0]);
+    assert(item != NULL);
+    assert(item->stack_size == 0);
+
+    op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+    assert(stats.maximum_objects == 24);
+    assert(stats.active_objects == 17);
+
+    op_ll_deinitialize_allocator(allocator1);
+}
+
+/*
+ * Cache-colored chunks start their first object on a cache line, a line further along in each chunk, and still clean
+ * up properly.
+ */
+static void ll_test15(void)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.cache_coloring = true;
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+
+    test_object *items[12];
+    for (size_t i = 0; i < 12; i++)
+    {
+        items[i] = op_ll_allocate_object(allocator1);
+        assert(items[i] != NULL);
+        if (i % MINIMUM_ALLOCATION_COUNT == 0)
+        {
+            assert((uintptr_t) items[i] % OP_CACHE_LINE_SIZE == 0);
+        }
+    }
+    for (size_t i = 4; i < 8; i++)
+    {
+        op_ll_deallocate_object(allocator1, items[i]);
+    }
+    assert(op_ll_compact(allocator1, NULL, NULL) == 1);
+    assert((uintptr_t) op_ll_allocate_object(allocator1) % OP_CACHE_LINE_SIZE == 0);
+
+    /* each chunk starts a line further into the color span, wrapping after the last color */
+    op_allocator allocator2 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    for (size_t c = 0; c < 2 * OP_CACHE_COLORS; c++)
+    {
+        test_object *first = NULL;
+        for (size_t i = 0; i < MINIMUM_ALLOCATION_COUNT; i++)
+        {
+            test_object *item = op_ll_allocate_object(allocator2);
+            assert(item != NULL);
+            first = first ? first : item;
+        }
+        assert((uintptr_t) first % (OP_CACHE_COLORS * OP_CACHE_LINE_SIZE) == c % OP_CACHE_COLORS * OP_CACHE_LINE_SIZE);
+    }
+
+    op_ll_deinitialize_allocator(allocator2);
+    op_ll_deinitialize_allocator(allocator1);
+}
+
+/*
+ * Padded objects each occupy whole cache lines, individually or in chunks, and the padding is reported.
+ */
+static void ll_test16(void)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.cache_line_padding = true;
+
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_DOUBLING_CHUNK, &config);
+    op_allocator allocator2 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_INDIVIDUAL, &config);
+
+    test_object *previous = NULL;
+    for (size_t i = 0; i < MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        test_object *item1 = op_ll_allocate_object(allocator1);
+        test_object *item2 = op_ll_allocate_object(allocator2);
+        assert((uintptr_t) item1 % OP_CACHE_LINE_SIZE == 0);
+        assert((uintptr_t) item2 % OP_CACHE_LINE_SIZE == 0);
+        assert(previous == NULL || (uint8_t *) item1 - (uint8_t *) previous == OP_CACHE_LINE_SIZE);
+        previous = item1;
+    }
+
+    op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+    assert(stats.slot_stride == OP_CACHE_LINE_SIZE);
+    assert(stats.padding_bytes == MINIMUM_ALLOCATION_COUNT * (OP_CACHE_LINE_SIZE - sizeof(test_object)));
+    stats = op_ll_get_allocator_stats(allocator2);
+    assert(stats.padding_bytes == MINIMUM_ALLOCATION_COUNT * (OP_CACHE_LINE_SIZE - sizeof(test_object)));
+
+    op_ll_deinitialize_allocator(allocator1);
+    op_ll_deinitialize_allocator(allocator2);
+}
+
+typedef struct hook_counts
+{
+    size_t constructed;
+    size_t destroyed;
+} hook_counts;
+
+static void construct_test_object(void *context, void *object)
+{
+    ((hook_counts *) context)->constructed++;
+    ((test_object *) object)->stack_size = 4096;
+}
+
+static void destroy_test_object(void *context, void *object)
+{
+    ((hook_counts *) context)->destroyed++;
+    assert(((test_object *) object)->stack_size == 4096);
+}
+
+/*
+ * Constructors run once per slot when memory is created, constructed state survives reuse and destructors run only
+ * when memory is freed.
+ */
+static void ll_test17(void)
+{
+    hook_counts counts = { 0 };
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.constructor = construct_test_object;
+    config.destructor = destroy_test_object;
+    config.hook_context = &counts;
+
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    assert(counts.constructed == MINIMUM_ALLOCATION_COUNT);
+
+    test_object *items[8];
+    for (size_t i = 0; i < 8; i++)
+    {
+        items[i] = op_ll_allocate_object(allocator1);
+        assert(items[i]->stack_size == 4096);
+        items[i]->running = true;
+    }
+    assert(counts.constructed == 8);
+    assert(counts.destroyed == 0);
+
+    op_ll_deallocate_object(allocator1, items[2]);
+    test_object *item = op_ll_allocate_object(allocator1);
+    assert(item == items[2]);
+    assert(item->running == true);
+    assert(counts.constructed == 8);
+
+    /* the live object swaps places with a spare constructed one, which is destroyed with its chunk */
+    for (size_t i = 0; i < 3; i++)
+    {
+        op_ll_deallocate_object(allocator1, items[i]);
+    }
+    for (size_t i = 5; i < 8; i++)
+    {
+        op_ll_deallocate_object(allocator1, items[i]);
+    }
+    relocation_log log = { 0 };
+    log.moved[0] = items[3];
+    assert(op_ll_compact(allocator1, log_relocation, &log) == 1);
+    assert(counts.destroyed == MINIMUM_ALLOCATION_COUNT);
+
+    op_ll_deinitialize_allocator(allocator1);
+    assert(counts.destroyed == counts.constructed);
+
+    config.cache_line_padding = true;
+    op_allocator allocator2 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_DOUBLING_INDIVIDUAL, &config);
+    item = op_ll_allocate_object(allocator2);
+    assert(item->stack_size == 4096);
+    op_ll_deinitialize_allocator(allocator2);
+    assert(counts.destroyed == counts.constructed);
+}
+
+/*
+ * Deferred zeroing moves zeroing into op_ll_scrub(), and allocation prefers objects which were already scrubbed.
+ */
+static void ll_test18(void)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.deferred_zeroing = true;
+
+    const size_t sizes[] = { sizeof(test_object), 8192 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        op_allocator allocator1 = op_ll_initialize_configured_allocator(sizes[s], MINIMUM_ALLOCATION_COUNT,
+                                  OP_LINEAR_CHUNK, &config);
+        test_object *items[MINIMUM_ALLOCATION_COUNT];
+        for (size_t i = 0; i < MINIMUM_ALLOCATION_COUNT; i++)
+        {
+            items[i] = op_ll_allocate_object(allocator1);
+            items[i]->running = true;
+            items[i]->stack_size = 1;
+        }
+        op_ll_deallocate_object(allocator1, items[1]);
+        op_ll_deallocate_object(allocator1, items[2]);
+
+        op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+        assert(stats.dirty_objects == 2);
+        assert(stats.inline_zeroings == 0);
+
+        /* nothing scrubbed yet, so allocation has to zero */
+        test_object *item = op_ll_allocate_object(allocator1);
+        assert(item->running == false && item->stack_size == 0);
+        stats = op_ll_get_allocator_stats(allocator1);
+        assert(stats.dirty_objects == 1);
+        assert(stats.inline_zeroings == 1);
+
+        op_ll_deallocate_object(allocator1, item);
+        op_ll_deallocate_object(allocator1, items[3]);
+        assert(op_ll_scrub(allocator1, 2) == 2);
+        assert(op_ll_scrub(allocator1, 2) == 1);
+        assert(op_ll_scrub(allocator1, 2) == 0);
+        assert(op_ll_get_allocator_stats(allocator1).dirty_objects == 0);
+
+        for (size_t i = 0; i < 3; i++)
+        {
+            item = op_ll_allocate_object(allocator1);
+            assert(item->running == false && item->stack_size == 0);
+        }
+        stats = op_ll_get_allocator_stats(allocator1);
+        assert(stats.inline_zeroings == 1);
+        assert(stats.maximum_objects == MINIMUM_ALLOCATION_COUNT);
+
+        op_ll_deinitialize_allocator(allocator1);
+    }
+}
+
+/*
+ * Bounded-latency allocators never grow on the allocation path; they request growth and op_ll_maintain() grows them.
+ */
+static void ll_test19(void)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.bounded_latency = true;
+    config.low_watermark = 2;
+    config.high_watermark = 6;
+
+    const op_ll_allocator_mode modes[] = { OP_LINEAR_CHUNK, OP_DOUBLING_INDIVIDUAL };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                                  modes[m], &config);
+        op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+        assert(stats.available_objects == MINIMUM_ALLOCATION_COUNT);
+        assert(stats.growth_pending == false);
+
+        /* falling below the low watermark requests growth once */
+        test_object *items[MINIMUM_ALLOCATION_COUNT];
+        for (size_t i = 0; i < MINIMUM_ALLOCATION_COUNT; i++)
+        {
+            items[i] = op_ll_allocate_object(allocator1);
+            assert(items[i] != NULL);
+        }
+        stats = op_ll_get_allocator_stats(allocator1);
+        assert(stats.available_objects == 0);
+        assert(stats.available_low_water == 0);
+        assert(stats.growth_pending == true);
+        assert(stats.growth_requests == 1);
+        assert(op_ll_growth_pending(allocator1));
+
+        /* without maintenance the pool stays as it is */
+        assert(op_ll_allocate_object(allocator1) == NULL);
+        stats = op_ll_get_allocator_stats(allocator1);
+        assert(stats.exhausted_allocations == 1);
+        assert(stats.maximum_objects == MINIMUM_ALLOCATION_COUNT);
+        assert(op_ll_capacity(allocator1) == MINIMUM_ALLOCATION_COUNT);
+
+        assert(op_ll_maintain(allocator1));
+        stats = op_ll_get_allocator_stats(allocator1);
+        assert(stats.available_objects >= config.high_watermark);
+        assert(stats.available_low_water == stats.available_objects);
+        assert(stats.growth_pending == false);
+        assert(!op_ll_growth_pending(allocator1));
+        assert(op_ll_capacity(allocator1) == stats.maximum_objects);
+        test_object *item = op_ll_allocate_object(allocator1);
+        assert(item != NULL && item->running == false);
+
+        op_ll_deinitialize_allocator(allocator1);
+    }
+
+    /* memory released by compaction is restored by maintenance rather than by allocation */
+    op_allocator allocator2 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    assert(op_ll_maintain(allocator2));
+    assert(op_ll_get_allocator_stats(allocator2).maximum_objects == 2 * MINIMUM_ALLOCATION_COUNT);
+    assert(op_ll_compact(allocator2, NULL, NULL) == 2);
+    assert(op_ll_get_allocator_stats(allocator2).available_objects == 0);
+    assert(op_ll_allocate_object(allocator2) == NULL);
+    assert(op_ll_maintain(allocator2));
+    op_allocator_stats stats = op_ll_get_allocator_stats(allocator2);
+    assert(stats.maximum_objects == 2 * MINIMUM_ALLOCATION_COUNT);
+    assert(stats.available_objects == 2 * MINIMUM_ALLOCATION_COUNT);
+    op_ll_deinitialize_allocator(allocator2);
+}
+
+/*
+ * Capacity limits stop the pool growing, and the overflow policy decides what allocation does past them.
+ */
+static void ll_test20(void)
+{
+    const op_ll_overflow_policy policies[] = { OP_OVERFLOW_FAIL, OP_OVERFLOW_RESERVE, OP_OVERFLOW_MALLOC };
+    const size_t still_overflowing[] = { 0, 1, 2 };
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++)
+    {
+        op_allocator_config config = op_ll_default_allocator_config();
+        config.max_objects = 6;
+        config.overflow = policies[p];
+        config.reserve_count = 2;
+
+        op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                                  OP_DOUBLING_CHUNK, &config);
+        test_object *items[6];
+        for (size_t i = 0; i < 6; i++)
+        {
+            items[i] = op_ll_allocate_object(allocator1);
+            assert(items[i] != NULL);
+        }
+        op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+        assert(stats.maximum_objects == 6);
+        assert(stats.capped_allocations == 0);
+
+        test_object *extra[3];
+        for (size_t i = 0; i < 3; i++)
+        {
+            extra[i] = op_ll_allocate_object(allocator1);
+        }
+        stats = op_ll_get_allocator_stats(allocator1);
+        assert(stats.maximum_objects == 6);
+        assert(stats.capped_allocations == 3);
+        switch (policies[p])
+        {
+        case OP_OVERFLOW_FAIL:
+            assert(extra[0] == NULL && extra[1] == NULL && extra[2] == NULL);
+            break;
+
+        case OP_OVERFLOW_RESERVE:
+            assert(extra[0] != NULL && extra[1] != NULL && extra[2] == NULL);
+            assert(stats.reserve_objects == 2);
+            break;
+
+        case OP_OVERFLOW_MALLOC:
+            assert(extra[0] != NULL && extra[1] != NULL && extra[2] != NULL);
+            assert(extra[2]->running == false && extra[2]->stack_size == 0);
+            assert(stats.spilled_objects == 3);
+            assert(stats.spilled_bytes == 3 * sizeof(test_object));
+            break;
+        }
+
+        /* overflow objects go back where they came from and pool objects are reused first */
+        op_ll_deallocate_object(allocator1, extra[0]);
+        op_ll_deallocate_object(allocator1, items[4]);
+        stats = op_ll_get_allocator_stats(allocator1);
+        assert(stats.active_objects == 5);
+        assert(stats.reserve_objects + stats.spilled_objects == still_overflowing[p]);
+        assert(op_ll_allocate_object(allocator1) == items[4]);
+
+        op_ll_deinitialize_allocator(allocator1);
+    }
+
+    /* byte limits clip the initial count too */
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.max_bytes = 3 * sizeof(test_object) + 1;
+    op_allocator allocator2 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_INDIVIDUAL, &config);
+    assert(op_ll_get_allocator_stats(allocator2).maximum_objects == 3);
+    op_ll_deinitialize_allocator(allocator2);
+
+    /* limits with no room for even one object are refused for what they are, whatever overflow would do */
+    config.max_bytes = sizeof(test_object) - 1;
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++)
+    {
+        config.overflow = policies[p];
+        last_error = NULL;
+        assert(op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                                                     OP_LINEAR_CHUNK, &config) == NULL);
+        assert(last_error && strcmp(last_error, "Capacity limits leave no room for a single object.") == 0);
+    }
+}
+
+typedef struct pressure_log
+{
+    _Atomic size_t highs;       /* callbacks may run on several threads at once */
+    _Atomic size_t lows;
+} pressure_log;
+
+static void log_pressure(void *context, op_ll_pressure_level level, size_t bytes_in_use)
+{
+    pressure_log *log = context;
+    if (level == OP_PRESSURE_HIGH) { log->highs++; }
+    else                           { log->lows++; }
+    UNUSED(bytes_in_use);
+}
+
+static void *churn_own_allocator(void *context)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.trim_on_pressure = *(bool *) context;
+    op_allocator allocator = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                             OP_LINEAR_CHUNK, &config);
+    test_object *items[64];
+    for (size_t round = 0; round < 200; round++)
+    {
+        for (size_t i = 0; i < 64; i++)
+        {
+            items[i] = op_ll_allocate_object(allocator);
+        }
+        for (size_t i = 0; i < 64; i++)
+        {
+            op_ll_deallocate_object(allocator, items[i]);
+        }
+        op_ll_compact(allocator, NULL, NULL);
+    }
+    op_ll_deinitialize_allocator(allocator);
+    return NULL;
+}
+
+static void *allocate_elsewhere(void *context)
+{
+    op_allocator allocator = op_ll_initialize_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT, OP_LINEAR_CHUNK);
+    assert(op_ll_allocate_object(allocator) != NULL);
+    op_ll_deinitialize_allocator(allocator);
+    UNUSED(context);
+    return NULL;
+}
+
+static void wait_for_allocating_thread(void *context, op_ll_pressure_level level, size_t bytes_in_use)
+{
+    log_pressure(context, level, bytes_in_use);
+    if (level == OP_PRESSURE_HIGH)
+    {
+        pthread_t thread;
+        assert(pthread_create(&thread, NULL, allocate_elsewhere, NULL) == 0);
+        assert(pthread_join(thread, NULL) == 0);
+    }
+}
+
+/*
+ * Crossing the process-wide memory budget trims idle chunks of opted-in allocators and notifies the application.
+ * Allocators used by different threads count against the same budget without losing bytes, and the pressure callback
+ * is free to wait on other threads which allocate.
+ */
+static void ll_test21(void)
+{
+    const size_t chunk_bytes = MINIMUM_ALLOCATION_COUNT * sizeof(test_object);
+    size_t base = op_ll_memory_in_use();
+
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.trim_on_pressure = true;
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    op_allocator allocator2 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, NULL);
+    op_allocator allocator3 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, NULL);
+    assert(op_ll_memory_in_use() == base + 3 * chunk_bytes);
+
+    /* allocator3 has not opted in, so its idle chunk survives every trim */
+    test_object *spare[MINIMUM_ALLOCATION_COUNT + 1];
+    for (size_t i = 0; i <= MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        spare[i] = op_ll_allocate_object(allocator3);
+    }
+    for (size_t i = 0; i <= MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        op_ll_deallocate_object(allocator3, spare[i]);
+    }
+    base += 2 * chunk_bytes;
+    assert(op_ll_memory_in_use() == base + 2 * chunk_bytes);
+
+    /* allocator1 leaves an idle chunk behind */
+    test_object *items[MINIMUM_ALLOCATION_COUNT + 1];
+    for (size_t i = 0; i <= MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        items[i] = op_ll_allocate_object(allocator1);
+    }
+    for (size_t i = 0; i < MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        op_ll_deallocate_object(allocator1, items[i]);
+    }
+    assert(op_ll_memory_in_use() == base + 3 * chunk_bytes);
+
+    pressure_log log = { 0 };
+    op_ll_set_memory_budget(base + 3 * chunk_bytes, base + 2 * chunk_bytes, log_pressure, &log);
+    assert(log.highs == 0);
+
+    /* growing allocator2 crosses the high watermark, which frees allocator1's idle chunk */
+    for (size_t i = 0; i <= MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        assert(op_ll_allocate_object(allocator2) != NULL);
+    }
+    assert(log.highs == 1 && log.lows == 0);
+    assert(op_ll_memory_in_use() == base + 3 * chunk_bytes);
+
+    op_ll_deinitialize_allocator(allocator2);
+    assert(log.highs == 1 && log.lows == 1);
+
+    op_ll_deallocate_object(allocator1, items[MINIMUM_ALLOCATION_COUNT]);
+    assert(op_ll_trim() == chunk_bytes);
+    assert(op_ll_memory_in_use() == base);
+
+    op_ll_set_memory_budget(0, 0, NULL, NULL);
+    op_ll_deinitialize_allocator(allocator3);
+    op_ll_deinitialize_allocator(allocator1);
+
+    /* the main thread trims its own opted-in allocator while the others leave theirs alone */
+    base = op_ll_memory_in_use();
+    log.highs = log.lows = 0;
+    op_ll_set_memory_budget(base + 1, base, log_pressure, &log);
+    bool trimmed = true, untrimmed = false;
+    pthread_t threads[3];
+    assert(pthread_create(&threads[0], NULL, churn_own_allocator, &untrimmed) == 0);
+    assert(pthread_create(&threads[1], NULL, churn_own_allocator, &untrimmed) == 0);
+    assert(pthread_create(&threads[2], NULL, churn_own_allocator, &untrimmed) == 0);
+    churn_own_allocator(&trimmed);
+    for (size_t t = 0; t < 3; t++)
+    {
+        assert(pthread_join(threads[t], NULL) == 0);
+    }
+    assert(op_ll_memory_in_use() == base);
+    assert(log.highs > 0 && log.highs == log.lows);
+
+    /* the callback runs without the budget's lock held, so it may wait on a thread which allocates */
+    pressure_log waited = { 0 };
+    op_ll_set_memory_budget(base + 1, base, wait_for_allocating_thread, &waited);
+    allocator1 = op_ll_initialize_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT, OP_LINEAR_CHUNK);
+    assert(waited.highs == 1 && waited.lows == 0);
+    op_ll_deinitialize_allocator(allocator1);
+    assert(waited.highs == 1 && waited.lows == 1);
+    op_ll_set_memory_budget(0, 0, NULL, NULL);
+}
+
+/* the tests drive the decay clock by hand */
+static uint64_t test_clock_ms = 0;
+
+/*
+ * Empty chunks are only released once they have stayed empty for the decay time.
+ */
+static void ll_test22(void)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.decay_ms = 100;
+    test_clock_ms = 1000;
+
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    test_object *items[MINIMUM_ALLOCATION_COUNT + 1];
+    for (size_t i = 0; i <= MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        items[i] = op_ll_allocate_object(allocator1);
+    }
+    op_ll_deallocate_object(allocator1, items[MINIMUM_ALLOCATION_COUNT]);
+    assert(op_ll_decay(allocator1) == 0);
+
+    /* a brief dip that refills the chunk restarts its decay */
+    test_clock_ms += 60;
+    items[MINIMUM_ALLOCATION_COUNT] = op_ll_allocate_object(allocator1);
+    op_ll_deallocate_object(allocator1, items[MINIMUM_ALLOCATION_COUNT]);
+    test_clock_ms += 60;
+    assert(op_ll_decay(allocator1) == 0);
+    test_clock_ms += 40;
+    assert(op_ll_decay(allocator1) == 1);
+    assert(op_ll_get_allocator_stats(allocator1).decayed_chunks == 1);
+
+    /* allocation and deallocation check for decayed chunks on their own */
+    items[MINIMUM_ALLOCATION_COUNT] = op_ll_allocate_object(allocator1);
+    op_ll_deallocate_object(allocator1, items[MINIMUM_ALLOCATION_COUNT]);
+    test_clock_ms += 100;
+    for (size_t i = 0; i < 64; i++)
+    {
+        op_ll_deallocate_object(allocator1, items[0]);
+        items[0] = op_ll_allocate_object(allocator1);
+    }
+    op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+    assert(stats.decayed_chunks == 2);
+    assert(stats.available_objects == 0);
+
+    op_ll_deinitialize_allocator(allocator1);
+}
+
+/*
+ * Advised release hands the pages of empty chunks back without unmapping them, so the slots keep their addresses.
+ */
+static void ll_test23(void)
+{
+    hook_counts counts = { 0 };
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.advise_release = true;
+    config.constructor = construct_test_object;
+    config.destructor = destroy_test_object;
+    config.hook_context = &counts;
+
+    const size_t object_size = 8192;
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(object_size, MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    test_object *items[2 * MINIMUM_ALLOCATION_COUNT];
+    for (size_t i = 0; i < 2 * MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        items[i] = op_ll_allocate_object(allocator1);
+    }
+    op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+    assert(stats.reserved_bytes == 2 * MINIMUM_ALLOCATION_COUNT * object_size);
+    assert(stats.resident_bytes == stats.reserved_bytes);
+
+    for (size_t i = MINIMUM_ALLOCATION_COUNT; i < 2 * MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        op_ll_deallocate_object(allocator1, items[i]);
+    }
+    assert(op_ll_compact(allocator1, NULL, NULL) == 1);
+    assert(op_ll_compact(allocator1, NULL, NULL) == 0);
+    assert(counts.destroyed == MINIMUM_ALLOCATION_COUNT);
+    stats = op_ll_get_allocator_stats(allocator1);
+    assert(stats.reserved_bytes == 2 * MINIMUM_ALLOCATION_COUNT * object_size);
+    assert(stats.resident_bytes < stats.reserved_bytes);
+
+    /* reuse brings back the same addresses, freshly constructed */
+    test_object *item = op_ll_allocate_object(allocator1);
+    assert(item == items[MINIMUM_ALLOCATION_COUNT]);
+    assert(item->stack_size == 4096);
+    assert(counts.constructed == 3 * MINIMUM_ALLOCATION_COUNT);
+    stats = op_ll_get_allocator_stats(allocator1);
+    assert(stats.resident_bytes == stats.reserved_bytes);
+    assert(stats.maximum_objects == 2 * MINIMUM_ALLOCATION_COUNT);
+
+    op_ll_deinitialize_allocator(allocator1);
+    assert(counts.destroyed == counts.constructed);
+}
+
+/* constructors of chunks initialized in parallel run concurrently, so this one only touches its own object */
+static void mark_test_object(void *context, void *object)
+{
+    UNUSED(context);
+    ((test_object *) object)->stack_size = 4096;
+}
+
+/*
+ * Large chunks may be initialized by several threads, with the same result as initializing them on one.
+ */
+static void ll_test24(void)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.init_threads = 4;
+
+    const size_t object_size = 4096, count = 4096;
+    const op_object_hook constructors[] = { NULL, mark_test_object };
+    for (size_t c = 0; c < sizeof(constructors) / sizeof(constructors[0]); c++)
+    {
+        config.constructor = constructors[c];
+        op_allocator allocator1 = op_ll_initialize_configured_allocator(object_size, count, OP_LINEAR_CHUNK, &config);
+        uint8_t *previous = op_ll_allocate_object(allocator1);
+        for (size_t i = 1; i < count; i++)
+        {
+            uint8_t *object = op_ll_allocate_object(allocator1);
+            assert(object == previous + object_size);
+            assert(((test_object *) object)->running == false);
+            assert(((test_object *) object)->stack_size == (constructors[c] ? 4096 : 0));
+            assert(object[object_size - 1] == 0);
+            previous = object;
+        }
+        assert(op_ll_get_allocator_stats(allocator1).maximum_objects == count);
+        op_ll_deinitialize_allocator(allocator1);
+    }
+}
+
+/*
+ * A snapshot restores every object, its handle and its pin, and changes after restoring never reach the file.
+ */
+static void ll_test25(void)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.cache_coloring = true;
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_DOUBLING_CHUNK, &config);
+    size_t handles[10];
+    for (size_t i = 0; i < 10; i++)
+    {
+        test_object *item = op_ll_allocate_object(allocator1);
+        item->stack_size = (int) i;
+        handles[i] = op_ll_object_handle(allocator1, item);
+        assert(op_ll_object_from_handle(allocator1, handles[i]) == item);
+    }
+    op_ll_deallocate_object(allocator1, op_ll_object_from_handle(allocator1, handles[3]));
+    op_ll_pin_object(allocator1, op_ll_object_from_handle(allocator1, handles[5]), true);
+    assert(op_ll_object_handle(allocator1, &handles[0]) == OP_NO_HANDLE);
+
+    char path[] = "/tmp/opalloc_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(op_ll_snapshot(allocator1, fd));
+    close(fd);
+    op_ll_deinitialize_allocator(allocator1);
+
+    for (size_t round = 0; round < 2; round++)
+    {
+        op_allocator allocator2 = op_ll_restore(path);
+        assert(allocator2 != NULL);
+        op_allocator_stats stats = op_ll_get_allocator_stats(allocator2);
+        assert(stats.active_objects == 9);
+        assert(stats.maximum_objects == 16);
+        for (size_t i = 0; i < 10; i++)
+        {
+            test_object *item = op_ll_object_from_handle(allocator2, handles[i]);
+            assert(i == 3 ? item == NULL : item != NULL && item->stack_size == (int) i);
+            if (item) { item->stack_size = -1; }
+        }
+
+        /* the pinned object stays where it is and freed slots are reused */
+        assert(op_ll_compact(allocator2, NULL, NULL) == 0);
+        test_object *item = op_ll_allocate_object(allocator2);
+        assert(op_ll_object_handle(allocator2, item) == handles[3]);
+        assert(item->running == false && item->stack_size == 0);
+
+        op_ll_deinitialize_allocator(allocator2);
+    }
+
+    /* a snapshot cut short is rejected rather than mapped past its end */
+    struct stat file;
+    assert(stat(path, &file) == 0);
+    assert(truncate(path, file.st_size - 1) == 0);
+    assert(op_ll_restore(path) == NULL);
+    assert(truncate(path, sizeof(uint64_t) * 8) == 0);
+    assert(op_ll_restore(path) == NULL);
+    unlink(path);
+
+    assert(op_ll_restore(path) == NULL);
+}
+
+/*
+ * Persistent pools keep objects, their handles and pins across reopening.
+ */
+static void ll_test26(void)
+{
+    char path[] = "/tmp/opalloc_pool_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    /* a new pool needs room for objects, and failing to create one leaves no file or header behind */
+    char missing[sizeof(path) + 4];
+    snprintf(missing, sizeof(missing), "%s.new", path);
+    assert(op_ll_open_persistent(missing, sizeof(test_object), 0, OP_DOUBLING_CHUNK) == NULL);
+    assert(access(missing, F_OK) != 0);
+    assert(op_ll_open_persistent(path, sizeof(test_object), 0, OP_DOUBLING_CHUNK) == NULL);
+    struct stat file;
+    assert(stat(path, &file) == 0 && file.st_size == 0);
+
+    op_allocator allocator1 = op_ll_open_persistent(path, sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_DOUBLING_CHUNK);
+    assert(allocator1 != NULL);
+    size_t handles[20];
+    for (size_t i = 0; i < 20; i++)
+    {
+        test_object *item = op_ll_allocate_object(allocator1);
+        item->stack_size = (int) i;
+        handles[i] = op_ll_object_handle(allocator1, item);
+    }
+    op_ll_deallocate_object(allocator1, op_ll_object_from_handle(allocator1, handles[4]));
+    op_ll_pin_object(allocator1, op_ll_object_from_handle(allocator1, handles[12]), true);
+    assert(op_ll_sync(allocator1));
+    op_ll_deinitialize_allocator(allocator1);
+
+    for (size_t round = 0; round < 2; round++)
+    {
+        op_allocator allocator2 = op_ll_open_persistent(path, sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                                  OP_LINEAR_CHUNK);
+        assert(allocator2 != NULL);
+        op_allocator_stats stats = op_ll_get_allocator_stats(allocator2);
+        assert(stats.active_objects == 19 + round);
+        assert(stats.maximum_objects == 32);
+        for (size_t i = 0; i < 20; i++)
+        {
+            test_object *item = op_ll_object_from_handle(allocator2, handles[i]);
+            if (i == 4)
+            {
+                assert((item == NULL) == (round == 0));
+            }
+            else
+            {
+                assert(item != NULL && item->stack_size == (int) (i + round * 100));
+                item->stack_size = (int) (i + 100);
+            }
+        }
+
+        /* the freed slot is reused and later reopened as in use */
+        if (round == 0)
+        {
+            test_object *item = op_ll_allocate_object(allocator2);
+            assert(op_ll_object_handle(allocator2, item) == handles[4]);
+            assert(item->stack_size == 0);
+            item->stack_size = 104;
+        }
+        assert(op_ll_compact(allocator2, NULL, NULL) == 0);
+
+        /* only one allocator may have the file open, and an existing pool opens whatever its initial count */
+        assert(op_ll_open_persistent(path, sizeof(test_object), MINIMUM_ALLOCATION_COUNT, OP_LINEAR_CHUNK) == NULL);
+        op_ll_deinitialize_allocator(allocator2);
+        op_allocator allocator3 = op_ll_open_persistent(path, sizeof(test_object), 0, OP_LINEAR_CHUNK);
+        assert(allocator3 != NULL);
+        op_ll_deinitialize_allocator(allocator3);
+    }
+
+    assert(op_ll_open_persistent(path, sizeof(test_object) + 1, MINIMUM_ALLOCATION_COUNT, OP_DOUBLING_CHUNK) == NULL);
+
+    /* a pool file cut short is refused rather than mapped past its end */
+    assert(stat(path, &file) == 0);
+    assert(truncate(path, file.st_size - 1) == 0);
+    assert(op_ll_open_persistent(path, sizeof(test_object), MINIMUM_ALLOCATION_COUNT, OP_LINEAR_CHUNK) == NULL);
+    unlink(path);
+}
+
+/*
+ * Processes sharing a pool pass objects as handles and can allocate from it at the same time.
+ */
+static void ll_test27(void)
+{
+    op_allocator allocator1 = op_ll_create_shared(NULL, sizeof(test_object), 1000);
+    assert(allocator1 != NULL);
+
+    int channel[2];
+    assert(pipe(channel) == 0);
+    pid_t child = fork();
+    assert(child >= 0);
+    if (child == 0)
+    {
+        /* churn alongside the parent, then hand over a batch of objects */
+        for (size_t round = 0; round < 10000; round++)
+        {
+            op_ll_deallocate_object(allocator1, op_ll_allocate_object(allocator1));
+        }
+        for (int i = 0; i < 100; i++)
+        {
+            test_object *item = op_ll_allocate_object(allocator1);
+            item->stack_size = i;
+            uint32_t handle = (uint32_t) op_ll_object_handle(allocator1, item);
+            if (write(channel[1], &handle, sizeof(handle)) != sizeof(handle)) { _exit(1); }
+        }
+        _exit(0);
+    }
+    close(channel[1]);
+    for (size_t round = 0; round < 10000; round++)
+    {
+        op_ll_deallocate_object(allocator1, op_ll_allocate_object(allocator1));
+    }
+    uint32_t handles[100];
+    for (int i = 0; i < 100; i++)
+    {
+        assert(read(channel[0], &handles[i], sizeof(handles[i])) == sizeof(handles[i]));
+        test_object *item = op_ll_object_from_handle(allocator1, handles[i]);
+        assert(item != NULL && item->stack_size == i);
+    }
+    close(channel[0]);
+    int status;
+    assert(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* no slot was handed out twice while both processes were allocating */
+    op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+    assert(stats.active_objects == 100);
+    assert(stats.maximum_objects == 1000);
+    assert(op_ll_capacity(allocator1) == 1000);
+    for (int i = 0; i < 100; i++)
+    {
+        op_ll_deallocate_object(allocator1, op_ll_object_from_handle(allocator1, handles[i]));
+    }
+    assert(op_ll_get_allocator_stats(allocator1).active_objects == 0);
+    op_ll_deinitialize_allocator(allocator1);
+
+    /* named pools can be attached to by name, and are full at their capacity */
+    char name[64];
+    snprintf(name, sizeof(name), "/opalloc_test.%ld", (long) getpid());
+    op_allocator allocator2 = op_ll_create_shared(name, sizeof(test_object), MINIMUM_ALLOCATION_COUNT);
+    assert(allocator2 != NULL);
+    assert(op_ll_create_shared(name, sizeof(test_object), MINIMUM_ALLOCATION_COUNT) == NULL);
+    op_allocator allocator3 = op_ll_attach_shared(name);
+    assert(allocator3 != NULL);
+    for (int i = 0; i < MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        test_object *item = op_ll_allocate_object(allocator2);
+        item->stack_size = i;
+        test_object *other = op_ll_object_from_handle(allocator3, op_ll_object_handle(allocator2, item));
+        assert(other != NULL && other != item && other->stack_size == i);
+    }
+    assert(op_ll_allocate_object(allocator3) == NULL);
+    test_object *item = op_ll_object_from_handle(allocator3, 2);
+    op_ll_deallocate_object(allocator3, item);
+    op_ll_deallocate_object(allocator3, item);
+    assert(op_ll_get_allocator_stats(allocator2).active_objects == MINIMUM_ALLOCATION_COUNT - 1);
+    assert(op_ll_object_handle(allocator2, op_ll_allocate_object(allocator2)) == 2);
+    op_ll_deinitialize_allocator(allocator3);
+    op_ll_deinitialize_allocator(allocator2);
+    shm_unlink(name);
+    assert(op_ll_attach_shared(name) == NULL);
+
+    /* a segment whose creator has not published its header yet is not attached to */
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    assert(fd >= 0 && ftruncate(fd, 4 * sysconf(_SC_PAGESIZE)) == 0);
+    assert(op_ll_attach_shared(name) == NULL);
+    close(fd);
+    shm_unlink(name);
+
+    /* sizes whose segment would overflow are refused rather than wrapped */
+    assert(op_ll_create_shared(NULL, SIZE_MAX / 2, 4) == NULL);
+    assert(op_ll_create_shared(NULL, SIZE_MAX, 1) == NULL);
+    assert(op_ll_create_shared(NULL, (SIZE_MAX >> 20) + 1, 1 << 20) == NULL);
+}
+
+typedef struct owning_object
+{
+    char *buffer;
+} owning_object;
+
+static void construct_owning_object(void *context, void *object)
+{
+    UNUSED(context);
+    ((owning_object *) object)->buffer = malloc(16);
+}
+
+static void destroy_owning_object(void *context, void *object)
+{
+    UNUSED(context);
+    free(((owning_object *) object)->buffer);
+}
+
+/*
+ * Clones start out with the same objects and go their own way after that.
+ */
+static void ll_test28(void)
+{
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.clonable = true;
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_DOUBLING_CHUNK, &config);
+    test_object *items[10];
+    for (int i = 0; i < 10; i++)
+    {
+        items[i] = op_ll_allocate_object(allocator1);
+        items[i]->stack_size = i;
+    }
+    op_ll_deallocate_object(allocator1, items[7]);
+
+    op_allocator allocator2 = op_ll_clone(allocator1);
+    assert(allocator2 != NULL);
+    op_allocator_stats stats = op_ll_get_allocator_stats(allocator2);
+    assert(stats.active_objects == 9);
+    assert(stats.maximum_objects == 16);
+
+    /* writes on either side stay on that side */
+    for (int i = 0; i < 10; i++)
+    {
+        test_object *copy = op_ll_object_from_handle(allocator2, op_ll_object_handle(allocator1, items[i]));
+        assert(i == 7 ? copy == NULL : copy != NULL && copy != items[i] && copy->stack_size == i);
+        if (copy) { copy->stack_size = -i; }
+    }
+    items[0]->running = true;
+    for (int i = 0; i < 10; i++)
+    {
+        assert(i == 7 || items[i]->stack_size == i);
+    }
+    assert(((test_object *) op_ll_object_from_handle(allocator2, 0))->running == false);
+
+    /* a clone of a clone copies the pages written since */
+    op_allocator allocator3 = op_ll_clone(allocator2);
+    assert(allocator3 != NULL);
+    assert(((test_object *) op_ll_object_from_handle(allocator3, 9))->stack_size == -9);
+    ((test_object *) op_ll_object_from_handle(allocator2, 9))->stack_size = 99;
+    assert(((test_object *) op_ll_object_from_handle(allocator3, 9))->stack_size == -9);
+
+    /* allocators grow and shrink independently */
+    for (int i = 0; i < 20; i++)
+    {
+        assert(op_ll_allocate_object(allocator2) != NULL);
+    }
+    assert(op_ll_get_allocator_stats(allocator1).active_objects == 9);
+    assert(op_ll_get_allocator_stats(allocator2).active_objects == 29);
+    op_ll_deallocate_object(allocator1, items[8]);
+    op_ll_deallocate_object(allocator1, items[9]);
+    assert(op_ll_compact(allocator1, NULL, NULL) == 1);
+    op_ll_deinitialize_allocator(allocator1);
+    assert(((test_object *) op_ll_object_from_handle(allocator3, 8))->stack_size == -8);
+    op_ll_deinitialize_allocator(allocator3);
+    op_ll_deinitialize_allocator(allocator2);
+
+    op_allocator allocator4 = op_ll_initialize_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_DOUBLING_CHUNK);
+    assert(op_ll_clone(allocator4) == NULL);
+    op_ll_deinitialize_allocator(allocator4);
+
+    /* objects spilled past the limits are copied too, and both sides count them against the budget */
+    size_t base = op_ll_memory_in_use();
+    config.max_objects = MINIMUM_ALLOCATION_COUNT;
+    config.overflow = OP_OVERFLOW_MALLOC;
+    op_allocator allocator6 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    for (int i = 0; i < MINIMUM_ALLOCATION_COUNT + 3; i++)
+    {
+        assert(op_ll_allocate_object(allocator6) != NULL);
+    }
+    op_allocator allocator7 = op_ll_clone(allocator6);
+    assert(allocator7 != NULL);
+    assert(op_ll_get_allocator_stats(allocator7).spilled_objects == 3);
+    op_ll_deinitialize_allocator(allocator7);
+    op_ll_deinitialize_allocator(allocator6);
+    assert(op_ll_memory_in_use() == base);
+    config.max_objects = 0;
+    config.overflow = OP_OVERFLOW_FAIL;
+
+    /* objects owning resources would be released by both sides, so they are never cloned */
+    config.constructor = construct_owning_object;
+    config.destructor = destroy_owning_object;
+    op_allocator allocator5 = op_ll_initialize_configured_allocator(sizeof(owning_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    owning_object *owner = op_ll_allocate_object(allocator5);
+    assert(owner->buffer != NULL);
+    assert(op_ll_clone(allocator5) == NULL);
+    op_ll_deallocate_object(allocator5, owner);
+    op_ll_deinitialize_allocator(allocator5);
+}
+
+/*
+ * I/O buffer pools hand out page-aligned buffers in batches from chunks which never move.
+ */
+static void ll_test29(void)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.io_buffers = true;
+    config.max_objects = 16;
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(1000, MINIMUM_ALLOCATION_COUNT, OP_DOUBLING_CHUNK,
+                              &config);
+    assert(op_ll_get_allocator_stats(allocator1).slot_stride == page);
+
+    struct iovec buffers[10];
+    assert(op_ll_allocate_iovec(allocator1, buffers, 10));
+    for (size_t i = 0; i < 10; i++)
+    {
+        assert((uintptr_t) buffers[i].iov_base % page == 0);
+        assert(buffers[i].iov_len == 1000);
+        memset(buffers[i].iov_base, 'a' + (int) i, buffers[i].iov_len);
+    }
+
+    /* every buffer lies in the region its index names */
+    struct iovec regions[8];
+    size_t region_count = op_ll_chunk_regions(allocator1, regions, 8);
+    assert(region_count == 3);
+    for (size_t i = 0; i < 10; i++)
+    {
+        const struct iovec *region = &regions[op_ll_object_region(allocator1, buffers[i].iov_base)];
+        assert((uint8_t *) buffers[i].iov_base >= (uint8_t *) region->iov_base);
+        assert((uint8_t *) buffers[i].iov_base + page <= (uint8_t *) region->iov_base + region->iov_len);
+    }
+
+    /* the batch goes through scatter-gather I/O as is */
+    char path[] = "/tmp/opalloc_iovec_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(writev(fd, buffers, 10) == 10000);
+    op_ll_deallocate_iovec(allocator1, buffers, 10);
+    assert(op_ll_get_allocator_stats(allocator1).active_objects == 0);
+    assert(op_ll_allocate_iovec(allocator1, buffers, 4));
+    assert(lseek(fd, 0, SEEK_SET) == 0);
+    assert(readv(fd, buffers, 4) == 4000);
+    assert(((char *) buffers[3].iov_base)[999] == 'd');
+    close(fd);
+    unlink(path);
+
+    /* emptied chunks stay where they were registered, and batches past the capacity allocate nothing */
+    assert(op_ll_compact(allocator1, NULL, NULL) == 0);
+    struct iovec after[8];
+    assert(op_ll_chunk_regions(allocator1, after, 8) == region_count);
+    for (size_t c = 0; c < region_count; c++)
+    {
+        assert(after[c].iov_base == regions[c].iov_base && after[c].iov_len == regions[c].iov_len);
+    }
+    struct iovec more[16];
+    assert(op_ll_allocate_iovec(allocator1, more, 0));
+    assert(!op_ll_allocate_iovec(allocator1, more, 13));
+    assert(op_ll_get_allocator_stats(allocator1).active_objects == 4);
+    assert(op_ll_allocate_iovec(allocator1, more, 12));
+
+    /* compaction moves no buffer out of a sparse chunk, as it may still be registered or in flight */
+    op_ll_deallocate_iovec(allocator1, &more[1], 10);
+    relocation_log log = { 0 };
+    assert(op_ll_compact(allocator1, log_relocation, &log) == 0);
+    assert(log.count == 0);
+    assert(op_ll_chunk_regions(allocator1, after, 8) == region_count);
+    for (size_t c = 0; c < region_count; c++)
+    {
+        assert(after[c].iov_base == regions[c].iov_base);
+    }
+    assert(op_ll_object_region(allocator1, more[11].iov_base) == region_count - 1);
+    assert(((char *) buffers[3].iov_base)[999] == 'd');
+    op_ll_deallocate_object(allocator1, more[0].iov_base);
+    op_ll_deallocate_object(allocator1, more[11].iov_base);
+    op_ll_deallocate_iovec(allocator1, buffers, 4);
+
+    /* a restored pool is still an I/O buffer pool, so it grows by page-aligned chunks that stay put */
+    assert(op_ll_allocate_iovec(allocator1, buffers, 4));
+    char snapshot[] = "/tmp/opalloc_iovec_snapshot_XXXXXX";
+    fd = mkstemp(snapshot);
+    assert(fd >= 0);
+    assert(op_ll_snapshot(allocator1, fd));
+    close(fd);
+    op_allocator allocator2 = op_ll_restore(snapshot);
+    unlink(snapshot);
+    assert(allocator2 != NULL);
+    assert(op_ll_get_allocator_stats(allocator2).slot_stride == page);
+    struct iovec grown[24];
+    assert(op_ll_allocate_iovec(allocator2, grown, 24));
+    assert(op_ll_get_allocator_stats(allocator2).maximum_objects > 16);
+    for (size_t i = 0; i < 24; i++)
+    {
+        assert((uintptr_t) grown[i].iov_base % page == 0);
+    }
+    op_ll_deallocate_iovec(allocator2, grown, 24);
+    region_count = op_ll_chunk_regions(allocator2, regions, 8);
+    assert(op_ll_compact(allocator2, NULL, NULL) == 0);
+    assert(op_ll_chunk_regions(allocator2, after, 8) == region_count);
+    for (size_t c = 0; c < region_count; c++)
+    {
+        assert(after[c].iov_base == regions[c].iov_base && (uintptr_t) after[c].iov_base % page == 0);
+    }
+    op_ll_deinitialize_allocator(allocator2);
+    op_ll_deallocate_iovec(allocator1, buffers, 4);
+
+    assert(op_ll_object_region(allocator1, &config) == OP_NO_HANDLE);
+    op_ll_deinitialize_allocator(allocator1);
+}
+
+/*
+ * Traces record every allocation, deallocation and growth, whether or not they fit in the thread's ring at once.
+ */
+static void ll_test30(void)
+{
+    char path[] = "/tmp/opalloc_trace_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+#if OP_TRACE
+    op_allocator allocator1 = op_ll_initialize_allocator(sizeof(test_object), 2, OP_DOUBLING_CHUNK);
+    op_allocator allocator2 = op_ll_initialize_allocator(sizeof(test_object), 2, OP_LINEAR_INDIVIDUAL);
+    test_object *objects[3];
+    assert(op_ll_trace_start(path));
+    assert(!op_ll_trace_start(path));
+    for (size_t i = 0; i < 3; i++)
+    {
+        objects[i] = op_ll_allocate_object(allocator1);
+    }
+    op_ll_deallocate_object(allocator1, objects[1]);
+    for (size_t i = 0; i < 3 * OP_TRACE_RING_RECORDS; i++)
+    {
+        op_ll_deallocate_object(allocator2, op_ll_allocate_object(allocator2));
+        if (i == OP_TRACE_RING_RECORDS)
+        {
+            op_ll_trace_flush();
+        }
+    }
+    assert(op_ll_trace_stop());
+    assert(!op_ll_trace_stop());
+    op_ll_deallocate_object(allocator1, objects[0]);    /* not traced */
+
+    FILE *trace = fopen(path, "rb");
+    op_trace_header header;
+    assert(fread(&header, sizeof(header), 1, trace) == 1);
+    assert(memcmp(header.magic, "OPTRACE", 8) == 0);
+    assert(header.record_size == sizeof(op_trace_record));
+    assert(header.stop_ns >= header.start_ns && header.stop_ticks >= header.start_ticks);
+    assert(header.records == 5 + 6 * OP_TRACE_RING_RECORDS && header.dropped == 0);
+
+    /* one thread, so the records are in the order they were made */
+    op_trace_record expected[] =
+    {
+        { 0, 1, 0, 1, OP_TRACE_ALLOCATE }, { 0, 1, 1, 1, OP_TRACE_ALLOCATE }, { 0, 1, 4, 1, OP_TRACE_GROW },
+        { 0, 1, 2, 1, OP_TRACE_ALLOCATE }, { 0, 1, 1, 1, OP_TRACE_DEALLOCATE },
+    };
+    op_trace_record record;
+    uint64_t last = header.start_ticks;
+    for (size_t r = 0; r < header.records; r++)
+    {
+        assert(fread(&record, sizeof(record), 1, trace) == 1);
+        assert(record.timestamp >= last && record.thread == 1);
+        last = record.timestamp;
+        if (r < 5)
+        {
+            assert(record.allocator == expected[r].allocator && record.slot == expected[r].slot);
+            assert(record.event == expected[r].event);
+        }
+        else
+        {
+            assert(record.allocator == 2 && record.slot == 0);
+            assert(record.event == ((r - 5) % 2 ? OP_TRACE_DEALLOCATE : OP_TRACE_ALLOCATE));
+        }
+    }
+    assert(fread(&record, sizeof(record), 1, trace) == 0);
+    fclose(trace);
+
+    op_ll_deallocate_object(allocator1, objects[2]);
+    op_ll_deinitialize_allocator(allocator2);
+    op_ll_deinitialize_allocator(allocator1);
+#else
+    assert(!op_ll_trace_start(path));
+    assert(!op_ll_trace_stop());
+#endif
+    unlink(path);
+}
+
+#if OP_TRACE
+typedef struct trace_worker
+{
+    size_t rounds;                  /* allocation and deallocation pairs to make */
+    _Atomic bool *running;          /* cleared to stop early */
+    _Atomic size_t events;          /* traced calls made */
+} trace_worker;
+
+static void *churn_traced_allocator(void *context)
+{
+    trace_worker *worker = context;
+    op_allocator allocator = op_ll_initialize_allocator(sizeof(test_object), 2, OP_LINEAR_CHUNK);
+    for (size_t round = 0; round < worker->rounds && atomic_load(worker->running); round++)
+    {
+        op_ll_deallocate_object(allocator, op_ll_allocate_object(allocator));
+        worker->events += 2;
+    }
+    op_ll_deinitialize_allocator(allocator);
+    return NULL;
+}
+#endif
+
+/*
+ * Threads tracing at once have their full rings drained by each other's flushes, account for every record they could
+ * not keep, and leave the file alone once the trace has stopped underneath them.
+ */
+static void ll_test31(void)
+{
+#if OP_TRACE
+    char path[] = "/tmp/opalloc_trace_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    /* the main thread flushes every ring while the workers fill theirs several times over */
+    _Atomic bool running = true;
+    trace_worker workers[4];
+    pthread_t threads[4];
+    assert(op_ll_trace_start(path));
+    for (size_t t = 0; t < 4; t++)
+    {
+        workers[t] = (trace_worker) { .rounds = 3 * OP_TRACE_RING_RECORDS, .running = &running };
+        assert(pthread_create(&threads[t], NULL, churn_traced_allocator, &workers[t]) == 0);
+    }
+    for (size_t t = 0; t < 4; t++)
+    {
+        while (atomic_load(&workers[t].events) < 6 * OP_TRACE_RING_RECORDS)
+        {
+            op_ll_trace_flush();
+            sched_yield();
+        }
+        assert(pthread_join(threads[t], NULL) == 0);
+    }
+    bool complete = op_ll_trace_stop();
+
+    FILE *trace = fopen(path, "rb");
+    op_trace_header header;
+    assert(fread(&header, sizeof(header), 1, trace) == 1);
+    assert(header.records + header.dropped == 4 * 6 * OP_TRACE_RING_RECORDS);
+    assert(complete == (header.dropped == 0));
+
+    /* every thread traced its own allocator, and nothing was written twice or left out */
+    uint32_t allocators[8] = { 0 };
+    op_trace_record record;
+    for (size_t r = 0; r < header.records; r++)
+    {
+        assert(fread(&record, sizeof(record), 1, trace) == 1);
+        assert(record.thread > 0 && record.slot == 0);
+        assert(record.event == OP_TRACE_ALLOCATE || record.event == OP_TRACE_DEALLOCATE);
+        uint32_t *owner = &allocators[record.thread % 8];
+        assert(*owner == 0 || *owner == record.allocator);
+        *owner = record.allocator;
+    }
+    assert(fread(&record, sizeof(record), 1, trace) == 0);
+    fclose(trace);
+
+    /* stopping while the workers are still going loses their remaining records, but never corrupts the file */
+    assert(op_ll_trace_start(path));
+    for (size_t t = 0; t < 4; t++)
+    {
+        workers[t] = (trace_worker) { .rounds = SIZE_MAX, .running = &running };
+        assert(pthread_create(&threads[t], NULL, churn_traced_allocator, &workers[t]) == 0);
+    }
+    while (atomic_load(&workers[0].events) < 2 * OP_TRACE_RING_RECORDS)
+    {
+        sched_yield();
+    }
+    op_ll_trace_stop();
+    atomic_store(&running, false);
+    size_t events = 0;
+    for (size_t t = 0; t < 4; t++)
+    {
+        assert(pthread_join(threads[t], NULL) == 0);
+        events += atomic_load(&workers[t].events);
+    }
+
+    struct stat file;
+    assert(stat(path, &file) == 0);
+    trace = fopen(path, "rb");
+    assert(fread(&header, sizeof(header), 1, trace) == 1);
+    assert(header.records + header.dropped <= events);
+    assert((size_t) file.st_size == sizeof(header) + header.records * sizeof(op_trace_record));
+    fclose(trace);
+    unlink(path);
+#endif
+}
+
 /* declare a type-safe allocator suite */
 OP_HL_DECLARE_ALLOCATOR(test_object, MINIMUM_ALLOCATION_COUNT, OP_DOUBLING_CHUNK);
 
@@ -357,15 +1964,106 @@ void hl_test1(void)
     UNUSED(item1i);
 }
 
+typedef struct padded_counter
+{
+    long hits;
+} padded_counter;
+
+/* declare a type-safe allocator suite for objects shared between threads */
+OP_HL_DECLARE_PADDED_ALLOCATOR(padded_counter, MINIMUM_ALLOCATION_COUNT, OP_LINEAR_CHUNK);
+
+/*
+ * Padded type-safe allocators keep every object on its own cache line.
+ */
+void hl_test2(void)
+{
+    padded_counter *counter1 = allocate_padded_counter();
+    padded_counter *counter2 = allocate_padded_counter();
+
+    assert(counter1 != NULL && counter2 != NULL);
+    assert((uintptr_t) counter1 % OP_CACHE_LINE_SIZE == 0);
+    assert((uintptr_t) counter2 % OP_CACHE_LINE_SIZE == 0);
+    assert(counter1->hits == 0 && counter2->hits == 0);
+
+    op_allocator_stats stats = op_ll_get_allocator_stats(padded_counter_allocator);
+    assert(stats.object_size == sizeof(padded_counter));
+    assert(stats.slot_stride == OP_CACHE_LINE_SIZE);
+
+    deallocate_padded_counter(counter1);
+    deallocate_padded_counter(counter2);
+    deinitialize_padded_counter_allocator();
+}
+
+/*
+ * Bounded-latency allocators leave due free list sorts and decay checks to op_ll_maintain(), so allocation and
+ * deallocation never free memory.
+ */
+static void ll_test32(void)
+{
+    hook_counts counts = { 0 };
+    op_allocator_config config = op_ll_default_allocator_config();
+    config.bounded_latency = true;
+    config.placement = OP_PLACE_LIFO;
+    config.free_list_sort_interval = 4;
+    config.decay_ms = 100;
+    config.constructor = construct_test_object;
+    config.destructor = destroy_test_object;
+    config.hook_context = &counts;
+    test_clock_ms = 1000;
+
+    /* one full chunk and one empty chunk grown by maintenance */
+    op_allocator allocator1 = op_ll_initialize_configured_allocator(sizeof(test_object), MINIMUM_ALLOCATION_COUNT,
+                              OP_LINEAR_CHUNK, &config);
+    test_object *items[MINIMUM_ALLOCATION_COUNT];
+    for (size_t i = 0; i < MINIMUM_ALLOCATION_COUNT; i++)
+    {
+        items[i] = op_ll_allocate_object(allocator1);
+    }
+    assert(op_ll_maintain(allocator1));
+    assert(counts.constructed == 2 * MINIMUM_ALLOCATION_COUNT);
+    for (size_t i = 0; i < MINIMUM_ALLOCATION_COUNT - 1; i++)
+    {
+        op_ll_deallocate_object(allocator1, items[i]);
+    }
+
+    /* the empty chunk has decayed and the free list is long overdue a sort, yet nothing is freed or sorted */
+    test_clock_ms += 200;
+    const size_t last = MINIMUM_ALLOCATION_COUNT - 1;
+    for (size_t i = 0; i < 128; i++)
+    {
+        op_ll_deallocate_object(allocator1, items[last]);
+        assert(op_ll_allocate_object(allocator1) == items[last]);
+    }
+    op_ll_deallocate_object(allocator1, items[last]);
+    op_allocator_stats stats = op_ll_get_allocator_stats(allocator1);
+    assert(counts.destroyed == 0);
+    assert(stats.decayed_chunks == 0);
+    assert(stats.maximum_objects == 2 * MINIMUM_ALLOCATION_COUNT);
+
+    /* maintenance catches up on both, and the emptied chunk is not grown back as the other one suffices */
+    assert(op_ll_maintain(allocator1));
+    stats = op_ll_get_allocator_stats(allocator1);
+    assert(counts.destroyed == MINIMUM_ALLOCATION_COUNT);
+    assert(stats.decayed_chunks == 1);
+    assert(stats.available_objects == MINIMUM_ALLOCATION_COUNT);
+    assert(op_ll_allocate_object(allocator1) == items[0]);
+    assert(op_ll_allocate_object(allocator1) == items[1]);
+
+    op_ll_deinitialize_allocator(allocator1);
+}
+
 static test_func ll_tests[] =
 {
-    ll_test1, ll_test2, ll_test3, ll_test4, ll_test5, ll_test6, ll_test7, ll_test8,
+    ll_test1, ll_test2, ll_test3, ll_test4, ll_test5, ll_test6, ll_test7, ll_test8, ll_test9, ll_test10,
+    ll_test11, ll_test12, ll_test13, ll_test14, ll_test15, ll_test16,
+    ll_test17, ll_test18, ll_test19, ll_test20, ll_test21, ll_test22, ll_test23, ll_test24,
+    ll_test25, ll_test26, ll_test27, ll_test28, ll_test29, ll_test30, ll_test31, ll_test32,
     NULL,
 };
 
 static test_func hl_tests[] =
 {
-    hl_test1,
+    hl_test1, hl_test2,
     NULL,
 };
 
@@ -399,5 +2097,11 @@ int main(int argc, char **argv)
 
 void op_error_handler(const char *file, const int line, const char *error_message)
 {
+    last_error = error_message;
     fprintf(stderr, "ERROR: %s (%d): %s\n", file, line, error_message);
 }
+
+uint64_t op_time_ms(void)
+{
+    return test_clock_ms;
+}